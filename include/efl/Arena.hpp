@@ -0,0 +1,498 @@
+//===- efl/Arena.hpp ------------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides bump/region allocators.
+//  None of the arenas here are thread-safe.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_ARENA_HPP
+#define EFL_ARENA_HPP
+
+#include <efl/Memory.hpp>
+#include <cstdio>
+
+#if defined(PLATFORM_WINDOWS)
+# include <windows.h>
+#elif defined(PLATFORM_LINUX) || defined(PLATFORM_ANDROID) || \
+  defined(PLATFORM_APPLE) || defined(PLATFORM_HAIKU) || \
+  defined(PLATFORM_SOLARIS) || defined(PLATFORM_SUNOS)
+# include <sys/mman.h>
+# include <unistd.h>
+# define EFLI_ARENA_MMAP_ 1
+#endif
+
+namespace efl {
+namespace config {
+namespace H {
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_ANDROID)
+  /// Reads the default hugetlbfs page size, or 0 if unavailable.
+  inline inl_szt_ readHugePageSize() NOEXCEPT {
+    std::FILE* const file = std::fopen("/proc/meminfo", "r");
+    if(!file)
+      return 0;
+    char line[128];
+    unsigned long kib = 0;
+    while(std::fgets(line, sizeof(line), file)) {
+      if(std::sscanf(line, "Hugepagesize: %lu kB", &kib) == 1)
+        break;
+    }
+    std::fclose(file);
+    return inl_szt_(kib) * 1024;
+  }
+
+  /// Checks if transparent huge pages can be requested with `madvise`.
+  inline bool hasTransparentHugePages() NOEXCEPT {
+    std::FILE* const file = std::fopen(
+      "/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if(!file)
+      return false;
+    char line[128] = {};
+    const bool read = (std::fgets(line, sizeof(line), file) != nullptr);
+    std::fclose(file);
+    return read && (std::strstr(line, "[never]") == nullptr);
+  }
+#endif // PLATFORM_LINUX
+
+  inline void unmapRegion(void* base, inl_szt_ size) NOEXCEPT {
+#if defined(EFLI_ARENA_MMAP_)
+    ::munmap(base, size);
+#elif defined(PLATFORM_WINDOWS)
+    (void) size;
+    ::VirtualFree(base, 0, MEM_RELEASE);
+#else
+    (void) size;
+    alignedFree(base);
+#endif
+  }
+} // namespace H
+
+/**
+ * A bump allocator over a single large mapping.
+ * On Linux, tries `MAP_HUGETLB`, then `madvise(MADV_HUGEPAGE)`,
+ * then falls back to normal pages. Meant for large, long-lived pools.
+ */
+class HugePageArena {
+public:
+  enum class PageKind {
+    NONE,         ///< Nothing mapped.
+    NORMAL,       ///< Base pages.
+    TRANSPARENT,  ///< Base pages, advised as THP.
+    HUGE_TLB,     ///< Explicit huge pages.
+  };
+
+  struct Stats {
+    H::inl_szt_ capacity;
+    H::inl_szt_ used;
+    H::inl_szt_ peak;
+    H::inl_szt_ allocations;
+    H::inl_szt_ pageSize;
+    PageKind kind;
+  };
+
+public:
+  HugePageArena() = default;
+  explicit HugePageArena(H::inl_szt_ capacity) NOEXCEPT
+  { this->reserve(capacity); }
+
+  HugePageArena(const HugePageArena&) = delete;
+  HugePageArena& operator=(const HugePageArena&) = delete;
+
+  HugePageArena(HugePageArena&& other) NOEXCEPT
+  { this->steal(other); }
+
+  HugePageArena& operator=(HugePageArena&& other) NOEXCEPT {
+    if(this != &other) {
+      this->release();
+      this->steal(other);
+    }
+    return *this;
+  }
+
+  ~HugePageArena() { this->release(); }
+
+  /// Maps a region of at least `capacity` bytes, releasing the old one.
+  bool reserve(H::inl_szt_ capacity) NOEXCEPT {
+    this->release();
+    if(capacity == 0)
+      return false;
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_ANDROID)
+    if(this->mapHugeTLB(capacity) || this->mapTransparent(capacity))
+      return true;
+#endif
+    return this->mapNormal(capacity);
+  }
+
+  /// Unmaps the region and clears all statistics.
+  void release() NOEXCEPT {
+    if(base_)
+      H::unmapRegion(base_, capacity_);
+    base_ = nullptr;
+    capacity_ = 0;
+    used_ = peak_ = allocations_ = 0;
+    pageSize_ = 0;
+    kind_ = PageKind::NONE;
+  }
+
+  /// Returns `nullptr` if the arena is exhausted.
+  COMPILER_UNALIASED EFL_ALLOC_SIZE(2) EFL_ALLOC_ALIGN(3) NODISCARD
+  void* allocate(H::inl_szt_ size,
+   H::inl_szt_ align = alignof(std::max_align_t)) NOEXCEPT {
+    if(!H::isPow2(align))
+      return nullptr;
+    if(!base_)
+      return nullptr;
+    const auto start = reinterpret_cast<H::inl_szt_>(base_);
+    const auto off = H::alignUp(start + used_, align) - start;
+    if(off > capacity_ || size > capacity_ - off)
+      return nullptr;
+    used_ = off + size;
+    if(used_ > peak_)
+      peak_ = used_;
+    ++allocations_;
+    return base_ + off;
+  }
+
+  template <typename T>
+  NODISCARD T* allocate(H::inl_szt_ count = 1) NOEXCEPT {
+    if(count > capacity_ / sizeof(T))
+      return nullptr;
+    return static_cast<T*>(this->allocate(sizeof(T) * count, alignof(T)));
+  }
+
+  /// Rewinds the arena, keeping the mapping.
+  void reset() NOEXCEPT {
+    used_ = 0;
+    allocations_ = 0;
+  }
+
+  bool isMapped() const NOEXCEPT { return base_ != nullptr; }
+  H::inl_szt_ capacity() const NOEXCEPT { return capacity_; }
+  H::inl_szt_ used() const NOEXCEPT { return used_; }
+  H::inl_szt_ remaining() const NOEXCEPT { return capacity_ - used_; }
+  /// The page size backing the mapping.
+  H::inl_szt_ pageSize() const NOEXCEPT { return pageSize_; }
+  PageKind pageKind() const NOEXCEPT { return kind_; }
+
+  Stats stats() const NOEXCEPT {
+    return Stats { capacity_, used_, peak_,
+      allocations_, pageSize_, kind_ };
+  }
+
+private:
+  static H::inl_szt_ basePageSize() NOEXCEPT {
+#if defined(EFLI_ARENA_MMAP_)
+    const long size = ::sysconf(_SC_PAGESIZE);
+    return (size > 0) ? H::inl_szt_(size) : Arch::pageSize;
+#elif defined(PLATFORM_WINDOWS)
+    SYSTEM_INFO info;
+    ::GetSystemInfo(&info);
+    return H::inl_szt_(info.dwPageSize);
+#else
+    return Arch::pageSize;
+#endif
+  }
+
+  void commit(void* base, H::inl_szt_ capacity,
+   H::inl_szt_ pageSize, PageKind kind) NOEXCEPT {
+    base_ = static_cast<char*>(base);
+    capacity_ = capacity;
+    pageSize_ = pageSize;
+    kind_ = kind;
+  }
+
+  void steal(HugePageArena& other) NOEXCEPT {
+    base_ = other.base_;
+    capacity_ = other.capacity_;
+    used_ = other.used_;
+    peak_ = other.peak_;
+    allocations_ = other.allocations_;
+    pageSize_ = other.pageSize_;
+    kind_ = other.kind_;
+    other.base_ = nullptr;
+    other.release();
+  }
+
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_ANDROID)
+  bool mapHugeTLB(H::inl_szt_ capacity) NOEXCEPT {
+# if defined(MAP_HUGETLB)
+    const H::inl_szt_ pageSize = H::readHugePageSize();
+    if(pageSize == 0)
+      return false;
+    const H::inl_szt_ size = H::alignUp(capacity, pageSize);
+    void* const base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(base == MAP_FAILED)
+      return false;
+    this->commit(base, size, pageSize, PageKind::HUGE_TLB);
+    return true;
+# else
+    (void) capacity;
+    return false;
+# endif
+  }
+
+  bool mapTransparent(H::inl_szt_ capacity) NOEXCEPT {
+# if defined(MADV_HUGEPAGE)
+    const H::inl_szt_ pageSize = Arch::hugePageSize;
+    if(pageSize == 0 || !H::hasTransparentHugePages())
+      return false;
+    // Over-map so the region can be trimmed to a huge page boundary.
+    const H::inl_szt_ size = H::alignUp(capacity, pageSize);
+    const H::inl_szt_ total = size + pageSize;
+    void* const raw = ::mmap(nullptr, total, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(raw == MAP_FAILED)
+      return false;
+    char* const start = static_cast<char*>(raw);
+    char* const base = reinterpret_cast<char*>(
+      H::alignUp(reinterpret_cast<H::inl_szt_>(start), pageSize));
+    const H::inl_szt_ head = H::inl_szt_(base - start);
+    if(head != 0)
+      ::munmap(start, head);
+    if(total - head - size != 0)
+      ::munmap(base + size, total - head - size);
+    if(::madvise(base, size, MADV_HUGEPAGE) != 0) {
+      this->commit(base, size, basePageSize(), PageKind::NORMAL);
+      return true;
+    }
+    this->commit(base, size, pageSize, PageKind::TRANSPARENT);
+    return true;
+# else
+    (void) capacity;
+    return false;
+# endif
+  }
+#endif // PLATFORM_LINUX
+
+  bool mapNormal(H::inl_szt_ capacity) NOEXCEPT {
+    const H::inl_szt_ pageSize = basePageSize();
+    const H::inl_szt_ size = H::alignUp(capacity, pageSize);
+#if defined(EFLI_ARENA_MMAP_)
+    void* const base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(base == MAP_FAILED)
+      return false;
+#elif defined(PLATFORM_WINDOWS)
+    void* const base = ::VirtualAlloc(nullptr, size,
+      MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if(!base)
+      return false;
+#else
+    void* const base = alignedAlloc(pageSize, size);
+    if(!base)
+      return false;
+#endif
+    this->commit(base, size, pageSize, PageKind::NORMAL);
+    return true;
+  }
+
+private:
+  char* base_ = nullptr;
+  H::inl_szt_ capacity_ = 0;
+  H::inl_szt_ used_ = 0;
+  H::inl_szt_ peak_ = 0;
+  H::inl_szt_ allocations_ = 0;
+  H::inl_szt_ pageSize_ = 0;
+  PageKind kind_ = PageKind::NONE;
+};
+
+/**
+ * A growable bump allocator for short-lived temporaries.
+ * Blocks are kept after `release`/`reset`, so rewinding is free.
+ * Use `ScratchArena::local()` for the calling thread's instance.
+ */
+class ScratchArena {
+  struct Block {
+    Block* next;
+    H::inl_szt_ size;
+  };
+
+  /// Keeps the usable region of each block cache-line-aligned.
+  static constexpr H::inl_szt_ headerSize =
+    (sizeof(Block) + Arch::cacheLineSize - 1) & ~(Arch::cacheLineSize - 1);
+
+public:
+  static constexpr H::inl_szt_ defaultBlockSize = 64 * 1024;
+
+  /// A saved position, returned by `mark()`.
+  struct Marker {
+    Block* block;
+    H::inl_szt_ used;
+  };
+
+  /// Rewinds the arena on destruction to where it was on construction.
+  class Scope {
+  public:
+    explicit Scope(ScratchArena& arena) NOEXCEPT
+     : arena_(arena), marker_(arena.mark()) { }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+    ~Scope() { arena_.release(marker_); }
+  private:
+    ScratchArena& arena_;
+    Marker marker_;
+  };
+
+public:
+  explicit ScratchArena(
+   H::inl_szt_ blockSize = defaultBlockSize) NOEXCEPT
+   : blockSize_(blockSize) { }
+
+  ScratchArena(const ScratchArena&) = delete;
+  ScratchArena& operator=(const ScratchArena&) = delete;
+
+  ~ScratchArena() { this->trim(0); }
+
+  /// The arena owned by the calling thread.
+  static ScratchArena& local() NOEXCEPT {
+    static THREAD_LOCAL ScratchArena arena;
+    return arena;
+  }
+
+  /// Returns `nullptr` if a new block could not be allocated.
+  COMPILER_UNALIASED EFL_ALLOC_SIZE(2) EFL_ALLOC_ALIGN(3) NODISCARD
+  void* allocate(H::inl_szt_ size,
+   H::inl_szt_ align = alignof(std::max_align_t)) NOEXCEPT {
+    if(!H::isPow2(align))
+      return nullptr;
+    if(curr_) {
+      const H::inl_szt_ off = H::alignUp(used_, align);
+      if(off <= curr_->size && size <= curr_->size - off) {
+        used_ = off + size;
+        return data(curr_) + off;
+      }
+    }
+    return this->allocateSlow(size, align);
+  }
+
+  template <typename T>
+  NODISCARD T* allocate(H::inl_szt_ count = 1) NOEXCEPT {
+    if(count > H::inl_szt_(-1) / sizeof(T))
+      return nullptr;
+    return static_cast<T*>(this->allocate(sizeof(T) * count, alignof(T)));
+  }
+
+  /// Allocates whole cache lines, so the result shares none with others.
+  COMPILER_UNALIASED EFL_ALLOC_SIZE(2) NODISCARD
+  void* allocateLines(H::inl_szt_ size) NOEXCEPT {
+    if(size > H::inl_szt_(-1) - Arch::cacheLineSize)
+      return nullptr;
+    const H::inl_szt_ lines = H::alignUp(size, Arch::cacheLineSize);
+    return this->allocate(lines, Arch::cacheLineSize);
+  }
+
+  NODISCARD Marker mark() const NOEXCEPT
+  { return Marker { curr_, used_ }; }
+
+  /// Frees everything allocated after `marker` was taken.
+  void release(Marker marker) NOEXCEPT {
+    if(!marker.block) {
+      this->reset();
+      return;
+    }
+    curr_ = marker.block;
+    used_ = marker.used;
+  }
+
+  /// Frees everything, keeping the blocks for reuse.
+  void reset() NOEXCEPT {
+    curr_ = head_;
+    used_ = 0;
+  }
+
+  /// Resets the arena and returns all but `keep` blocks to the system.
+  void trim(H::inl_szt_ keep = 1) NOEXCEPT {
+    Block** link = &head_;
+    while(*link && keep > 0) {
+      link = &(*link)->next;
+      --keep;
+    }
+    Block* block = *link;
+    *link = nullptr;
+    while(block) {
+      Block* const next = block->next;
+      alignedFree(block);
+      block = next;
+    }
+    this->reset();
+  }
+
+  H::inl_szt_ blockSize() const NOEXCEPT { return blockSize_; }
+
+  /// Total bytes held, including unused blocks.
+  H::inl_szt_ reserved() const NOEXCEPT {
+    H::inl_szt_ total = 0;
+    for(const Block* block = head_; block; block = block->next)
+      total += block->size;
+    return total;
+  }
+
+private:
+  static char* data(Block* block) NOEXCEPT
+  { return reinterpret_cast<char*>(block) + headerSize; }
+
+  NOINLINE void* allocateSlow(H::inl_szt_ size, H::inl_szt_ align) NOEXCEPT {
+    // Blocks are only cache-line-aligned, so pad for larger requests.
+    const H::inl_szt_ pad = (align > Arch::cacheLineSize) ? align : 0;
+    if(size > H::inl_szt_(-1) - headerSize - pad)
+      return nullptr;
+    const H::inl_szt_ need = size + pad;
+    Block* next = curr_ ? curr_->next : head_;
+    if(!next || next->size < need) {
+      next = newBlock((need > blockSize_) ? need : blockSize_);
+      if(!next)
+        return nullptr;
+      this->link(next);
+    }
+    curr_ = next;
+    const H::inl_szt_ off = (pad == 0) ? 0 :
+      H::alignUp(reinterpret_cast<H::inl_szt_>(data(curr_)), align)
+        - reinterpret_cast<H::inl_szt_>(data(curr_));
+    used_ = off + size;
+    return data(curr_) + off;
+  }
+
+  static Block* newBlock(H::inl_szt_ size) NOEXCEPT {
+    void* const raw = alignedAlloc(Arch::cacheLineSize, headerSize + size);
+    if(!raw)
+      return nullptr;
+    Block* const block = static_cast<Block*>(raw);
+    block->next = nullptr;
+    block->size = size;
+    return block;
+  }
+
+  /// Links `block` directly after the current one.
+  void link(Block* block) NOEXCEPT {
+    Block** const slot = curr_ ? &curr_->next : &head_;
+    block->next = *slot;
+    *slot = block;
+  }
+
+private:
+  Block* head_ = nullptr;
+  Block* curr_ = nullptr;
+  H::inl_szt_ used_ = 0;
+  H::inl_szt_ blockSize_;
+};
+
+} // namespace config
+} // namespace efl
+
+#endif // EFL_ARENA_HPP
@@ -0,0 +1,181 @@
+//===- efl/Atomic.hpp -----------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides atomic operations on plain memory.
+//  Useful when memory can't be wrapped in `std::atomic` (eg. shared maps).
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_ATOMIC_HPP
+#define EFL_ATOMIC_HPP
+
+#include <efl/Config.hpp>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(COMPILER_MSVC)
+# include <intrin.h>
+#endif
+
+namespace efl {
+namespace config {
+namespace H {
+  template <typename T>
+  struct IsPlainAtomic {
+    static constexpr bool value =
+      std::is_trivially_copyable<T>::value &&
+      (sizeof(T) == 1 || sizeof(T) == 2 ||
+       sizeof(T) == 4 || sizeof(T) == 8) &&
+      (sizeof(T) <= Arch::maxLockFreeWidth);
+  };
+
+#if defined(COMPILER_MSVC)
+  template <inl_szt_ N> struct MsvcWord;
+  template <> struct MsvcWord<1> { using type = __int8; };
+  template <> struct MsvcWord<2> { using type = __int16; };
+  template <> struct MsvcWord<4> { using type = __int32; };
+  template <> struct MsvcWord<8> { using type = __int64; };
+
+  inline __int8 msvcCas(volatile __int8* dst, __int8 want, __int8 old)
+  { return _InterlockedCompareExchange8(dst, want, old); }
+  inline __int16 msvcCas(volatile __int16* dst, __int16 want, __int16 old)
+  { return _InterlockedCompareExchange16(dst, want, old); }
+  inline __int32 msvcCas(volatile __int32* dst, __int32 want, __int32 old) {
+    return _InterlockedCompareExchange(
+      reinterpret_cast<volatile long*>(dst), want, old);
+  }
+  inline __int64 msvcCas(volatile __int64* dst, __int64 want, __int64 old)
+  { return _InterlockedCompareExchange64(dst, want, old); }
+#endif
+} // namespace H
+
+/// Loads `*addr` with acquire ordering.
+template <typename T>
+ALWAYS_INLINE T atomicLoadAcquire(const T* addr) NOEXCEPT {
+  static_assert(H::IsPlainAtomic<T>::value,
+    "`T` must be trivially copyable and lock-free sized.");
+#if defined(COMPILER_GNU) || defined(COMPILER_LLVM)
+  T out;
+  __atomic_load(addr, &out, __ATOMIC_ACQUIRE);
+  return out;
+#elif defined(COMPILER_MSVC)
+  using W = typename H::MsvcWord<sizeof(T)>::type;
+  W word = *reinterpret_cast<const volatile W*>(addr);
+# if defined(ARCH_ARM64)
+  __dmb(_ARM64_BARRIER_ISH);
+# elif defined(ARCH_ARM)
+  __dmb(_ARM_BARRIER_ISH);
+# else
+  // x86 loads already have acquire semantics.
+  _ReadWriteBarrier();
+# endif
+  T out;
+  std::memcpy(&out, &word, sizeof(T));
+  return out;
+#endif
+}
+
+/// Stores `value` to `*addr` with release ordering.
+template <typename T>
+ALWAYS_INLINE void atomicStoreRelease(T* addr, T value) NOEXCEPT {
+  static_assert(H::IsPlainAtomic<T>::value,
+    "`T` must be trivially copyable and lock-free sized.");
+#if defined(COMPILER_GNU) || defined(COMPILER_LLVM)
+  __atomic_store(addr, &value, __ATOMIC_RELEASE);
+#elif defined(COMPILER_MSVC)
+  using W = typename H::MsvcWord<sizeof(T)>::type;
+  W word;
+  std::memcpy(&word, &value, sizeof(T));
+# if defined(ARCH_ARM64)
+  __dmb(_ARM64_BARRIER_ISH);
+# elif defined(ARCH_ARM)
+  __dmb(_ARM_BARRIER_ISH);
+# else
+  // x86 stores already have release semantics.
+  _ReadWriteBarrier();
+# endif
+  *reinterpret_cast<volatile W*>(addr) = word;
+#endif
+}
+
+/**
+ * Sequentially consistent compare-and-swap on `*addr`.
+ * On failure, `expected` is updated with the current value.
+ */
+template <typename T>
+ALWAYS_INLINE bool atomicCompareExchange(
+ T* addr, T& expected, T desired) NOEXCEPT {
+  static_assert(H::IsPlainAtomic<T>::value,
+    "`T` must be trivially copyable and lock-free sized.");
+#if defined(COMPILER_GNU) || defined(COMPILER_LLVM)
+  return __atomic_compare_exchange(addr, &expected, &desired,
+    false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#elif defined(COMPILER_MSVC)
+  using W = typename H::MsvcWord<sizeof(T)>::type;
+  W want, old;
+  std::memcpy(&want, &desired, sizeof(T));
+  std::memcpy(&old, &expected, sizeof(T));
+  const W prev = H::msvcCas(
+    reinterpret_cast<volatile W*>(addr), want, old);
+  if(prev == old)
+    return true;
+  std::memcpy(&expected, &prev, sizeof(T));
+  return false;
+#endif
+}
+
+#if EFL_ARCH_HAS_DWCAS && (EFL_ARCH_REGMAX == 64)
+/// A pair of words for `cas128`, eg. a tagged pointer.
+struct alignas(16) Word128 {
+  std::uint64_t lo;
+  std::uint64_t hi;
+};
+
+/**
+ * Double-width compare-and-swap (`cmpxchg16b`, `casp` or `ldxp`/`stxp`).
+ * Only defined when `Arch::hasDoubleWidthCAS` on 64-bit targets.
+ * On failure, `expected` is updated with the current value.
+ */
+ALWAYS_INLINE bool cas128(
+ Word128* addr, Word128& expected, Word128 desired) NOEXCEPT {
+# if defined(COMPILER_MSVC)
+  return _InterlockedCompareExchange128(
+    reinterpret_cast<volatile __int64*>(addr),
+    static_cast<__int64>(desired.hi), static_cast<__int64>(desired.lo),
+    reinterpret_cast<__int64*>(&expected)) != 0;
+# else
+  EFL_EXTENSION typedef unsigned __int128 U128;
+  U128 old, want;
+  std::memcpy(&old, &expected, sizeof(U128));
+  std::memcpy(&want, &desired, sizeof(U128));
+  // The `__sync` form is inlined, `__atomic` goes through libatomic on GCC.
+  const U128 prev = __sync_val_compare_and_swap(
+    reinterpret_cast<U128*>(addr), old, want);
+  if(prev == old)
+    return true;
+  std::memcpy(&expected, &prev, sizeof(U128));
+  return false;
+# endif
+}
+#endif // EFL_ARCH_HAS_DWCAS
+
+} // namespace config
+} // namespace efl
+
+#endif // EFL_ATOMIC_HPP
@@ -85,6 +85,37 @@ EFL_REGION_BEGIN("config.macro.opts")
 # define EFLI_NDEBUG_ 1
 #endif
 
+#ifndef COMPILER_FAST_MATH
+/// If IEEE semantics may be relaxed (`-ffast-math`, `/fp:fast`).
+# if defined(__FAST_MATH__) || (defined(EFLI_MSVC_) && defined(_M_FP_FAST))
+#  define COMPILER_FAST_MATH 1
+# else
+#  define COMPILER_FAST_MATH 0
+# endif
+#endif
+
+#ifndef COMPILER_FP_CONTRACT
+/**
+ * If `a * b + c` may be fused into a single rounding. No compiler
+ * reports `-ffp-contract`, so this is inferred from the defaults:
+ * GCC fuses in GNU modes, Clang within expressions, and neither
+ * without hardware FMA (`__FP_FAST_FMA`).
+ */
+# if defined(EFLI_MSVC_)
+#  if (defined(_M_FP_CONTRACT) || defined(_M_FP_FAST)) && defined(__AVX2__)
+#   define COMPILER_FP_CONTRACT 1
+#  else
+#   define COMPILER_FP_CONTRACT 0
+#  endif
+# elif !defined(__FP_FAST_FMA) && !defined(__FP_FAST_FMAF)
+#  define COMPILER_FP_CONTRACT 0
+# elif COMPILER_FAST_MATH || defined(__clang__) || !defined(__STRICT_ANSI__)
+#  define COMPILER_FP_CONTRACT 1
+# else
+#  define COMPILER_FP_CONTRACT 0
+# endif
+#endif
+
 #ifndef COMPILER_UNICODE_VERSION
 /**
  * Determines which prefix will be used with `USTRIFY`.
@@ -197,6 +228,15 @@ EFL_REGION_BEGIN("config.macro.opts")
 # define EFL_EXTENSION
 #endif
 
+#ifndef EFL_HAS_VECTOR_EXT
+/// If GCC style `__attribute__((vector_size(N)))` types are supported.
+# if (defined(__GNUC__) || defined(__clang__)) && !defined(EFLI_MSVC_)
+#  define EFL_HAS_VECTOR_EXT 1
+# else
+#  define EFL_HAS_VECTOR_EXT 0
+# endif
+#endif
+
 EFL_REGION_CLOSE("config.macro.opts")
 
 
@@ -270,6 +310,19 @@ EFL_REGION_BEGIN("config.macro.meta")
 #define REG32   0b0100
 #define REG64   0b1000
 
+/*
+ * Microarchitecture levels, compare greater for newer levels.
+ * x86 follows the psABI levels, ARM the architecture version.
+ */
+
+#define VMICROARCH_GENERIC  0
+#define VMICROARCH_X86_V1   1
+#define VMICROARCH_X86_V2   2
+#define VMICROARCH_X86_V3   3
+#define VMICROARCH_X86_V4   4
+#define VMICROARCH_ARMV8    8
+#define VMICROARCH_ARMV9    9
+
 /// Number of supported C++ versions
 #define COMPILER_VERSION_COUNT 6
 /// Lowest supported C++ version
@@ -507,6 +560,26 @@ EFL_REGION_BEGIN("config.macro.cpp")
 # endif
 #endif
 
+/// Makes `return f(...)` a guaranteed jump, or a compile error.
+#if __has_cpp_attribute(clang::musttail)
+# define EFL_MUSTTAIL [[clang::musttail]]
+# define EFL_HAS_MUSTTAIL 1
+#elif __has_cpp_attribute(gnu::musttail)
+# define EFL_MUSTTAIL [[gnu::musttail]]
+# define EFL_HAS_MUSTTAIL 1
+#else
+# define EFL_MUSTTAIL
+# define EFL_HAS_MUSTTAIL 0
+#endif
+
+/// If `&&label` and `goto *ptr` are supported.
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(EFLI_MSVC_)
+# define EFL_HAS_LABELS_AS_VALUES 1
+#else
+# define EFL_HAS_LABELS_AS_VALUES 0
+#endif
+#define EFL_HAS_COMPUTED_GOTO EFL_HAS_LABELS_AS_VALUES
+
 /*
  * Used to determine the standard for the current C++ version.
  * The standard is the value of XX in `C++XX`
@@ -659,21 +732,82 @@ EFL_REGION_BEGIN("config.macro.compiler")
 #define EFL_ERROR_IF(expr, msg) \
   EFLI_DIAGNOSE_IF_((expr), msg, "error")
 
-#if defined(COMPILER_MINGW)
-# define CLRCALL __clrcall
-# define STDCALL __stdcall
-# define VECCALL
-#elif defined(COMPILER_MSVC)
-# define CLRCALL __clrcall
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || \
+  (defined(_M_X64) && !defined(_M_ARM64EC))
+# define EFLI_CC_X86_ 1
+#endif
+
+// Only meaningful on 32-bit x86, other targets accept and ignore them.
+#if defined(EFLI_MSVC_) || defined(__MINGW32__)
+# define CDECL __cdecl
 # define STDCALL __stdcall
-# define VECCALL __vectorcall
+# define FASTCALL __fastcall
 #else
 # define CDECL
+# define STDCALL
+# define FASTCALL
+#endif
+
+#if defined(EFLI_MSVC_) && defined(_M_CEE)
+# define CLRCALL __clrcall
+#else
 # define CLRCALL
+#endif
+
+/// Passes vector arguments and aggregates of them in registers.
+#if defined(EFLI_MSVC_) && defined(EFLI_CC_X86_) && !defined(_M_CEE)
+# define VECCALL __vectorcall
+# define EFL_HAS_VECCALL 1
+#elif defined(COMPILER_LLVM) && defined(_WIN32) && \
+  defined(EFLI_CC_X86_) && __has_attribute(vectorcall)
+# define VECCALL __attribute__((vectorcall))
+# define EFL_HAS_VECCALL 1
+#else
 # define VECCALL
-# define FASTCALL
+# define EFL_HAS_VECCALL 0
+#endif
+
+/**
+ * Callee saves almost every register, so the caller doesn't have to
+ * spill around the call. Put it on cold functions (error paths,
+ * slow-path refills) that are called from hot loops.
+ * The callee pays for the saves instead, and can't be inlined
+ * through a function pointer of a different convention.
+ */
+#if defined(COMPILER_LLVM) && __has_attribute(preserve_most) && \
+  (defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__))
+# define EFL_PRESERVE_MOST __attribute__((preserve_most))
+# define EFL_HAS_PRESERVE_MOST 1
+#else
+# define EFL_PRESERVE_MOST
+# define EFL_HAS_PRESERVE_MOST 0
 #endif
 
+/// Like `EFL_PRESERVE_MOST`, but also keeps vector registers.
+#if defined(COMPILER_LLVM) && __has_attribute(preserve_all) && \
+  (defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__))
+# define EFL_PRESERVE_ALL __attribute__((preserve_all))
+# define EFL_HAS_PRESERVE_ALL 1
+#else
+# define EFL_PRESERVE_ALL
+# define EFL_HAS_PRESERVE_ALL 0
+#endif
+
+/// Passes as many arguments (and returns) in registers as possible.
+#if defined(COMPILER_ICC) && defined(EFLI_CC_X86_)
+# define EFL_REGCALL __regcall
+# define EFL_HAS_REGCALL 1
+#elif defined(COMPILER_LLVM) && defined(EFLI_CC_X86_) && \
+  __has_attribute(regcall)
+# define EFL_REGCALL __attribute__((regcall))
+# define EFL_HAS_REGCALL 1
+#else
+# define EFL_REGCALL
+# define EFL_HAS_REGCALL 0
+#endif
+
+#undef EFLI_CC_X86_
+
 #if defined(COMPILER_LLVM) || defined(COMPILER_MSVC)
 # define RESTRICT __restrict
 #elif defined(COMPILER_GNU)
@@ -776,6 +910,40 @@ EFL_REGION_BEGIN("config.macro.compiler")
 # define COMPILER_UNALIASED
 #endif
 
+/// Marks the parameter(s) holding the size of the returned allocation.
+#if __has_cpp_attribute(gnu::alloc_size)
+# define EFL_ALLOC_SIZE(...) [[gnu::alloc_size(__VA_ARGS__)]]
+#elif __has_attribute(alloc_size) || defined(__GNUC__)
+# define EFL_ALLOC_SIZE(...) __attribute__((alloc_size(__VA_ARGS__)))
+#else
+# define EFL_ALLOC_SIZE(...)
+#endif
+
+/// Marks the parameter holding the alignment of the returned allocation.
+#if __has_cpp_attribute(gnu::alloc_align)
+# define EFL_ALLOC_ALIGN(n) [[gnu::alloc_align(n)]]
+#elif __has_attribute(alloc_align)
+# define EFL_ALLOC_ALIGN(n) __attribute__((alloc_align(n)))
+#else
+# define EFL_ALLOC_ALIGN(n)
+#endif
+
+/**
+ * TLS model overrides for `THREAD_LOCAL` variables.
+ * Initial-exec skips `__tls_get_addr`, but can fail to `dlopen` if static TLS
+ * space runs out. Local-exec is only valid in the main executable.
+ */
+#if __has_cpp_attribute(gnu::tls_model)
+# define EFL_TLS_INITIAL_EXEC [[gnu::tls_model("initial-exec")]]
+# define EFL_TLS_LOCAL_EXEC [[gnu::tls_model("local-exec")]]
+#elif __has_attribute(tls_model) || defined(__GNUC__)
+# define EFL_TLS_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
+# define EFL_TLS_LOCAL_EXEC __attribute__((tls_model("local-exec")))
+#else
+# define EFL_TLS_INITIAL_EXEC
+# define EFL_TLS_LOCAL_EXEC
+#endif
+
 #if __has_attribute(nodebug)
 # define NODEBUG __attribute__((nodebug))
 #else
@@ -1017,7 +1185,7 @@ EFL_REGION_BEGIN("config.macro.platform")
 
 /// Architecture detection
 #ifndef ARCH_CUSTOM
-#if defined(__aarch64)
+#if defined(__aarch64__) || defined(__aarch64) || defined(_M_ARM64)
 # define ARCH_ARM64 "ARM64"
 # define EFL_ARCH_CURR REG64
 # define ARCH_TYPE ARCH_ARM64
@@ -1089,14 +1257,50 @@ EFL_REGION_BEGIN("config.macro.platform")
 #endif // ARCH_CUSTOM
 
 #ifndef MICROARCH_TYPE
-#if defined(ARCH_x86)
-// TODO: Microarchitecture Detection
-// May not end up using this.
+#if defined(ARCH_AMD64) || defined(ARCH_x86_32)
+# if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512CD__) && \
+  defined(__AVX512DQ__) && defined(__AVX512VL__)
+#  define MICROARCH_X86_V4 X86_V4
+#  define MICROARCH_CURR VMICROARCH_X86_V4
+#  define MICROARCH_TYPE MICROARCH_X86_V4
+# elif defined(__AVX2__) && \
+  ((defined(__BMI2__) && defined(__FMA__)) || defined(EFLI_MSVC_))
+#  define MICROARCH_X86_V3 X86_V3
+#  define MICROARCH_CURR VMICROARCH_X86_V3
+#  define MICROARCH_TYPE MICROARCH_X86_V3
+# elif (defined(__SSE4_2__) && defined(__POPCNT__) && defined(__SSSE3__)) || \
+  (defined(EFLI_MSVC_) && defined(__AVX__))
+#  define MICROARCH_X86_V2 X86_V2
+#  define MICROARCH_CURR VMICROARCH_X86_V2
+#  define MICROARCH_TYPE MICROARCH_X86_V2
+# elif defined(__SSE2__) || defined(_M_AMD64) || \
+  (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#  define MICROARCH_X86_V1 X86_V1
+#  define MICROARCH_CURR VMICROARCH_X86_V1
+#  define MICROARCH_TYPE MICROARCH_X86_V1
+# endif
+#elif defined(ARCH_ARM64)
+# if defined(__ARM_ARCH) && (__ARM_ARCH >= 9)
+#  define MICROARCH_ARMV9 ARMV9
+#  define MICROARCH_CURR VMICROARCH_ARMV9
+#  define MICROARCH_TYPE MICROARCH_ARMV9
+# else
+#  define MICROARCH_ARMV8 ARMV8
+#  define MICROARCH_CURR VMICROARCH_ARMV8
+#  define MICROARCH_TYPE MICROARCH_ARMV8
+# endif
 #endif
 #endif // MICROARCH_TYPE
 
+#ifndef MICROARCH_TYPE
+# define MICROARCH_GENERIC GENERIC
+# define MICROARCH_CURR VMICROARCH_GENERIC
+# define MICROARCH_TYPE MICROARCH_GENERIC
+#endif
+
 #define EFL_PLATFORM_NAME STRIFY(PLATFORM_TYPE)
 #define EFL_ARCH_NAME STRIFY(ARCH_TYPE)
+#define EFL_MICROARCH_NAME STRIFY(MICROARCH_TYPE)
 
 #if   (EFL_ARCH_CURR & REG64) != 0
 # define EFL_ARCH_REGMAX 64
@@ -1114,6 +1318,172 @@ EFL_REGION_BEGIN("config.macro.platform")
 # define EFL_ARCH_BITS CHAR_BIT
 #endif
 
+#ifndef EFL_ARCH_PAGE_SIZE
+/// The base page size, may be larger at runtime.
+# if defined(ARCH_ARM64) && defined(PLATFORM_APPLE)
+#  define EFL_ARCH_PAGE_SIZE 16384
+# else
+#  define EFL_ARCH_PAGE_SIZE 4096
+# endif
+#endif
+
+#ifndef EFL_ARCH_CACHE_LINE_SIZE
+/// The L1 data cache line size.
+# if defined(ARCH_ARM64) && defined(PLATFORM_APPLE)
+#  define EFL_ARCH_CACHE_LINE_SIZE 128
+# else
+#  define EFL_ARCH_CACHE_LINE_SIZE 64
+# endif
+#endif
+
+#ifndef EFL_ARCH_DESTRUCTIVE_INTERFERENCE
+/// Minimum offset to avoid false sharing, covers adjacent line prefetch.
+# if defined(ARCH_AMD64) || defined(ARCH_x86_32) || \
+  (defined(ARCH_ARM64) && !defined(PLATFORM_APPLE))
+#  define EFL_ARCH_DESTRUCTIVE_INTERFERENCE (EFL_ARCH_CACHE_LINE_SIZE * 2)
+# else
+#  define EFL_ARCH_DESTRUCTIVE_INTERFERENCE EFL_ARCH_CACHE_LINE_SIZE
+# endif
+#endif
+
+#ifndef EFL_ARCH_CONSTRUCTIVE_INTERFERENCE
+/// Maximum size of contiguous memory to promote true sharing.
+# define EFL_ARCH_CONSTRUCTIVE_INTERFERENCE EFL_ARCH_CACHE_LINE_SIZE
+#endif
+
+#ifndef EFL_ARCH_HAS_LSE
+/// If ARMv8.1 atomics (`cas`, `casp`, `ldadd`...) are available.
+# if defined(ARCH_ARM64) && defined(__ARM_FEATURE_ATOMICS)
+#  define EFL_ARCH_HAS_LSE 1
+# else
+#  define EFL_ARCH_HAS_LSE 0
+# endif
+#endif
+
+#ifndef EFL_ARCH_HAS_DWCAS
+/// If compare-and-swap on two adjacent pointers is lock-free.
+# if defined(ARCH_AMD64) && \
+  (defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16) || defined(EFLI_MSVC_))
+#  define EFL_ARCH_HAS_DWCAS 1
+# elif defined(ARCH_ARM64)
+// `ldxp`/`stxp` on all of ARMv8, `casp` with LSE.
+#  define EFL_ARCH_HAS_DWCAS 1
+# elif defined(ARCH_x86_32) && \
+  (defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8) || defined(EFLI_MSVC_))
+#  define EFL_ARCH_HAS_DWCAS 1
+# else
+#  define EFL_ARCH_HAS_DWCAS 0
+# endif
+#endif
+
+#ifndef EFL_ARCH_MAX_LOCK_FREE_WIDTH
+/// The widest lock-free atomic access in bytes.
+# if EFL_ARCH_HAS_DWCAS
+#  define EFL_ARCH_MAX_LOCK_FREE_WIDTH (EFL_ARCH_REGMAX / 4)
+# else
+#  define EFL_ARCH_MAX_LOCK_FREE_WIDTH (EFL_ARCH_REGMAX / 8)
+# endif
+#endif
+
+#ifndef EFL_ARCH_HUGE_PAGE_SIZE
+/// The default huge page size, or 0 if unsupported.
+# if defined(ARCH_AMD64) || defined(ARCH_ARM64) || defined(ARCH_x86_32)
+#  define EFL_ARCH_HUGE_PAGE_SIZE 0x200000
+# else
+#  define EFL_ARCH_HUGE_PAGE_SIZE 0
+# endif
+#endif
+
+/// Compile-time ISA extensions, from the target flags (eg. `-mavx2`).
+#ifndef EFL_ARCH_HAS_SSE2
+# if defined(__SSE2__) || defined(_M_AMD64) || \
+  (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#  define EFL_ARCH_HAS_SSE2 1
+# else
+#  define EFL_ARCH_HAS_SSE2 0
+# endif
+#endif
+
+#ifndef EFL_ARCH_HAS_AVX2
+# if defined(__AVX2__)
+#  define EFL_ARCH_HAS_AVX2 1
+# else
+#  define EFL_ARCH_HAS_AVX2 0
+# endif
+#endif
+
+#ifndef EFL_ARCH_HAS_AVX512F
+# if defined(__AVX512F__)
+#  define EFL_ARCH_HAS_AVX512F 1
+# else
+#  define EFL_ARCH_HAS_AVX512F 0
+# endif
+#endif
+
+#ifndef EFL_ARCH_HAS_AVX512BW
+# if defined(__AVX512BW__)
+#  define EFL_ARCH_HAS_AVX512BW 1
+# else
+#  define EFL_ARCH_HAS_AVX512BW 0
+# endif
+#endif
+
+#ifndef EFL_ARCH_HAS_NEON
+# if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#  define EFL_ARCH_HAS_NEON 1
+# else
+#  define EFL_ARCH_HAS_NEON 0
+# endif
+#endif
+
+// MSVC has no flag for these, but every `/arch:AVX` target has them.
+#ifndef EFL_ARCH_HAS_SSE42
+# if defined(__SSE4_2__) || (defined(EFLI_MSVC_) && defined(__AVX__))
+#  define EFL_ARCH_HAS_SSE42 1
+# else
+#  define EFL_ARCH_HAS_SSE42 0
+# endif
+#endif
+
+#ifndef EFL_ARCH_HAS_PCLMUL
+# if defined(__PCLMUL__) || (defined(EFLI_MSVC_) && defined(__AVX__))
+#  define EFL_ARCH_HAS_PCLMUL 1
+# else
+#  define EFL_ARCH_HAS_PCLMUL 0
+# endif
+#endif
+
+#ifndef EFL_ARCH_HAS_CRC32
+/// If the ARMv8 `crc32c*` instructions are available.
+# if defined(__ARM_FEATURE_CRC32) || (defined(EFLI_MSVC_) && defined(_M_ARM64))
+#  define EFL_ARCH_HAS_CRC32 1
+# else
+#  define EFL_ARCH_HAS_CRC32 0
+# endif
+#endif
+
+#ifndef EFL_ARCH_HAS_PMULL
+/// If the ARMv8 64-bit polynomial multiply (`pmull`) is available.
+# if defined(__ARM_FEATURE_AES) || defined(__ARM_FEATURE_CRYPTO)
+#  define EFL_ARCH_HAS_PMULL 1
+# else
+#  define EFL_ARCH_HAS_PMULL 0
+# endif
+#endif
+
+#ifndef EFL_ARCH_SIMD_WIDTH
+/// The widest enabled vector register in bytes, or 0 without SIMD.
+# if EFL_ARCH_HAS_AVX512F
+#  define EFL_ARCH_SIMD_WIDTH 64
+# elif EFL_ARCH_HAS_AVX2 || defined(__AVX__)
+#  define EFL_ARCH_SIMD_WIDTH 32
+# elif EFL_ARCH_HAS_SSE2 || EFL_ARCH_HAS_NEON
+#  define EFL_ARCH_SIMD_WIDTH 16
+# else
+#  define EFL_ARCH_SIMD_WIDTH 0
+# endif
+#endif
+
 EFL_REGION_CLOSE("config.macro.platform")
 
 
@@ -1204,6 +1574,15 @@ struct Compiler {
   static constexpr auto supertype = CompilerSuperType(COMPILER_CURR & VCOMPILER_SUPERTYPE_MASK);
   static constexpr auto standard = StandardType::EFL_CAT(CPP, COMPILER_STANDARD);
   static constexpr decltype(EFL_COMPILER_NAME) name = EFL_COMPILER_NAME;
+  static constexpr bool hasVectorExt = (EFL_HAS_VECTOR_EXT != 0);
+  static constexpr bool fastMath = (COMPILER_FAST_MATH != 0);
+  static constexpr bool fpContract = (COMPILER_FP_CONTRACT != 0);
+  static constexpr bool hasVecCall = (EFL_HAS_VECCALL != 0);
+  static constexpr bool hasPreserveMost = (EFL_HAS_PRESERVE_MOST != 0);
+  static constexpr bool hasPreserveAll = (EFL_HAS_PRESERVE_ALL != 0);
+  static constexpr bool hasRegCall = (EFL_HAS_REGCALL != 0);
+  static constexpr bool hasMustTail = (EFL_HAS_MUSTTAIL != 0);
+  static constexpr bool hasComputedGoto = (EFL_HAS_COMPUTED_GOTO != 0);
 };
 } // namespace config
 
@@ -1235,10 +1614,40 @@ namespace H {
   typedef decltype(sizeof(0)) inl_szt_;
 } // namespace detail_
 
+enum class MicroarchType {
+  GENERIC = VMICROARCH_GENERIC,
+  X86_V1  = VMICROARCH_X86_V1,
+  X86_V2  = VMICROARCH_X86_V2,
+  X86_V3  = VMICROARCH_X86_V3,
+  X86_V4  = VMICROARCH_X86_V4,
+  ARMV8   = VMICROARCH_ARMV8,
+  ARMV9   = VMICROARCH_ARMV9,
+};
+
 struct Arch {
   static constexpr decltype(EFL_ARCH_NAME) name = EFL_ARCH_NAME;
+  static constexpr auto microarch = MicroarchType::MICROARCH_TYPE;
+  static constexpr decltype(EFL_MICROARCH_NAME) microarchName = EFL_MICROARCH_NAME;
   static constexpr H::inl_szt_ archMax = EFL_ARCH_REGMAX;
   static constexpr H::inl_szt_ bitCount = EFL_ARCH_BITS;
+  static constexpr H::inl_szt_ cacheLineSize = EFL_ARCH_CACHE_LINE_SIZE;
+  static constexpr H::inl_szt_ destructiveInterference = EFL_ARCH_DESTRUCTIVE_INTERFERENCE;
+  static constexpr H::inl_szt_ constructiveInterference = EFL_ARCH_CONSTRUCTIVE_INTERFERENCE;
+  static constexpr H::inl_szt_ pageSize = EFL_ARCH_PAGE_SIZE;
+  static constexpr H::inl_szt_ hugePageSize = EFL_ARCH_HUGE_PAGE_SIZE;
+  static constexpr H::inl_szt_ maxLockFreeWidth = EFL_ARCH_MAX_LOCK_FREE_WIDTH;
+  static constexpr bool hasDoubleWidthCAS = (EFL_ARCH_HAS_DWCAS != 0);
+  static constexpr bool hasLSE = (EFL_ARCH_HAS_LSE != 0);
+  static constexpr bool hasSSE2 = (EFL_ARCH_HAS_SSE2 != 0);
+  static constexpr bool hasAVX2 = (EFL_ARCH_HAS_AVX2 != 0);
+  static constexpr bool hasAVX512F = (EFL_ARCH_HAS_AVX512F != 0);
+  static constexpr bool hasAVX512BW = (EFL_ARCH_HAS_AVX512BW != 0);
+  static constexpr bool hasNEON = (EFL_ARCH_HAS_NEON != 0);
+  static constexpr bool hasSSE42 = (EFL_ARCH_HAS_SSE42 != 0);
+  static constexpr bool hasPCLMUL = (EFL_ARCH_HAS_PCLMUL != 0);
+  static constexpr bool hasCRC32 = (EFL_ARCH_HAS_CRC32 != 0);
+  static constexpr bool hasPMULL = (EFL_ARCH_HAS_PMULL != 0);
+  static constexpr H::inl_szt_ simdWidth = EFL_ARCH_SIMD_WIDTH;
   static_assert((archMax / bitCount) == sizeof(void*),
     "Uneven `archMax`, try using a custom ARCH.");
 };
@@ -0,0 +1,456 @@
+//===- efl/Coro.hpp -------------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides lazy coroutine tasks and generators.
+//  Only available with C++20 coroutines (see `EFL_HAS_COROUTINES`).
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_CORO_HPP
+#define EFL_CORO_HPP
+
+#include <efl/Sync.hpp>
+
+#if CPPVER_LEAST(20) && defined(__cpp_impl_coroutine) && \
+  __has_include(<coroutine>)
+# define EFL_HAS_COROUTINES 1
+#else
+# define EFL_HAS_COROUTINES 0
+#endif
+
+#if EFL_HAS_COROUTINES
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#ifndef EFL_CORO_FRAME_BUCKETS
+/// Number of 64 byte size classes cached by `FramePool`.
+# define EFL_CORO_FRAME_BUCKETS 32
+#endif
+
+#ifndef EFL_CORO_FRAME_CACHE
+/// Most frames kept per size class, per thread.
+# define EFL_CORO_FRAME_CACHE 64
+#endif
+
+namespace efl {
+namespace config {
+namespace H {
+  /**
+   * Thread-local, size-bucketed free lists for coroutine frames.
+   * Frames freed on another thread join that thread's lists.
+   * Oversized frames go straight to `::operator new`.
+   */
+  class FramePool {
+    static constexpr inl_szt_ granule = 64;
+    static constexpr inl_szt_ buckets = EFL_CORO_FRAME_BUCKETS;
+    static constexpr inl_szt_ limit = EFL_CORO_FRAME_CACHE;
+
+    struct Node { Node* next; };
+    struct Bucket {
+      Node* head = nullptr;
+      inl_szt_ count = 0;
+    };
+
+  public:
+    FramePool() = default;
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    ~FramePool() {
+      for(inl_szt_ i = 0; i < buckets; ++i) {
+        while(Node* node = lists_[i].head) {
+          lists_[i].head = node->next;
+          ::operator delete(node);
+        }
+      }
+    }
+
+    static FramePool& local() NOEXCEPT {
+      static THREAD_LOCAL FramePool pool;
+      return pool;
+    }
+
+    static void* allocate(inl_szt_ size) {
+      const inl_szt_ index = bucketOf(size);
+      if(index >= buckets)
+        return ::operator new(size);
+      Bucket& bucket = local().lists_[index];
+      if(Node* const node = bucket.head) {
+        bucket.head = node->next;
+        --bucket.count;
+        return node;
+      }
+      return ::operator new((index + 1) * granule);
+    }
+
+    static void deallocate(void* ptr, inl_szt_ size) NOEXCEPT {
+      const inl_szt_ index = bucketOf(size);
+      if(index >= buckets) {
+        ::operator delete(ptr);
+        return;
+      }
+      Bucket& bucket = local().lists_[index];
+      if(bucket.count >= limit) {
+        ::operator delete(ptr);
+        return;
+      }
+      Node* const node = static_cast<Node*>(ptr);
+      node->next = bucket.head;
+      bucket.head = node;
+      ++bucket.count;
+    }
+
+  private:
+    static constexpr inl_szt_ bucketOf(inl_szt_ size) NOEXCEPT
+    { return (size + granule - 1) / granule - 1; }
+
+  private:
+    Bucket lists_[buckets];
+  };
+
+  /// Routes frame allocation of a promise type through `FramePool`.
+  struct PooledPromise {
+    static void* operator new(inl_szt_ size)
+    { return FramePool::allocate(size); }
+    static void operator delete(void* ptr, inl_szt_ size) NOEXCEPT
+    { FramePool::deallocate(ptr, size); }
+  };
+
+  template <typename T>
+  class TaskResult {
+  public:
+    template <typename U>
+    void return_value(U&& value)
+     NOEXCEPT(std::is_nothrow_constructible<T, U&&>::value) {
+      ::new(static_cast<void*>(&storage_)) T(std::forward<U>(value));
+      hasValue_ = true;
+    }
+
+    void unhandled_exception() NOEXCEPT
+    { error_ = std::current_exception(); }
+
+    T take() {
+      if(error_)
+        std::rethrow_exception(error_);
+      return std::move(*std::launder(reinterpret_cast<T*>(&storage_)));
+    }
+
+    ~TaskResult() {
+      if(hasValue_)
+        std::launder(reinterpret_cast<T*>(&storage_))->~T();
+    }
+
+  private:
+    alignas(T) unsigned char storage_[sizeof(T)];
+    bool hasValue_ = false;
+    std::exception_ptr error_;
+  };
+
+  template <>
+  class TaskResult<void> {
+  public:
+    void return_void() NOEXCEPT { }
+    void unhandled_exception() NOEXCEPT
+    { error_ = std::current_exception(); }
+    void take() {
+      if(error_)
+        std::rethrow_exception(error_);
+    }
+
+  private:
+    std::exception_ptr error_;
+  };
+} // namespace H
+
+/**
+ * A lazily started coroutine producing a `T`, resumed by `co_await`.
+ * Completion transfers control straight back to the awaiter, so
+ * chains of tasks don't grow the stack. Frames come from `FramePool`.
+ * With Clang, frames of directly awaited tasks can be elided.
+ * Must be awaited to completion before being destroyed.
+ */
+template <typename T = void>
+class CORO_ANALYZE CORO_COMPLETION_DTOR Task {
+public:
+  struct promise_type : H::PooledPromise, H::TaskResult<T> {
+    Task get_return_object() NOEXCEPT {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() const NOEXCEPT { return {}; }
+
+    struct FinalAwaiter {
+      bool await_ready() const NOEXCEPT { return false; }
+      std::coroutine_handle<> await_suspend(
+       std::coroutine_handle<promise_type> self) const NOEXCEPT {
+        const std::coroutine_handle<> next = self.promise().continuation;
+        return next ? next : std::noop_coroutine();
+      }
+      void await_resume() const NOEXCEPT { }
+    };
+    FinalAwaiter final_suspend() const NOEXCEPT { return {}; }
+
+    std::coroutine_handle<> continuation;
+  };
+
+  using handle_type = std::coroutine_handle<promise_type>;
+
+public:
+  Task() = default;
+  Task(Task&& other) NOEXCEPT
+   : handle_(std::exchange(other.handle_, nullptr)) { }
+  Task& operator=(Task&& other) NOEXCEPT {
+    if(this != &other) {
+      if(handle_)
+        handle_.destroy();
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+  }
+  ~Task() {
+    if(handle_)
+      handle_.destroy();
+  }
+
+  bool isValid() const NOEXCEPT { return bool(handle_); }
+  bool isDone() const NOEXCEPT { return handle_ && handle_.done(); }
+
+  /// Awaiting an empty (default or moved-from) task throws `std::logic_error`.
+  auto operator co_await() && NOEXCEPT {
+    struct Awaiter {
+      bool await_ready() const NOEXCEPT { return !handle || handle.done(); }
+      std::coroutine_handle<> await_suspend(
+       std::coroutine_handle<> caller) NOEXCEPT {
+        handle.promise().continuation = caller;
+        return handle;
+      }
+      T await_resume() {
+        Task::checkValid(handle);
+        return handle.promise().take();
+      }
+      handle_type handle;
+    };
+    return Awaiter { handle_ };
+  }
+
+  /**
+   * Sets what resumes after completion and returns the handle to
+   * transfer to, for drivers like `syncWait` that collect `result()`.
+   */
+  std::coroutine_handle<> launch(
+   std::coroutine_handle<> continuation) NOEXCEPT {
+    handle_.promise().continuation = continuation;
+    return handle_;
+  }
+
+  /// The result after completion, rethrows any escaped exception.
+  T result() {
+    Task::checkValid(handle_);
+    return handle_.promise().take();
+  }
+
+private:
+  explicit Task(handle_type handle) NOEXCEPT : handle_(handle) { }
+
+  static void checkValid(handle_type handle) {
+    if(!handle)
+      throw std::logic_error("efl::config::Task: empty task.");
+  }
+
+private:
+  handle_type handle_ = nullptr;
+};
+
+/**
+ * A synchronous generator, values are produced on each `co_yield`
+ * and consumed with a range-for. Frames come from `FramePool`.
+ */
+template <typename T>
+class CORO_ANALYZE Generator {
+public:
+  using value_type = std::remove_cvref_t<T>;
+  using reference = std::conditional_t<
+    std::is_reference_v<T>, T, const value_type&>;
+
+  struct promise_type : H::PooledPromise {
+    Generator get_return_object() NOEXCEPT {
+      return Generator(
+        std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() const NOEXCEPT { return {}; }
+    std::suspend_always final_suspend() const NOEXCEPT { return {}; }
+
+    std::suspend_always yield_value(
+     std::remove_reference_t<reference>& value) NOEXCEPT {
+      current = std::addressof(value);
+      return {};
+    }
+    std::suspend_always yield_value(
+     std::remove_reference_t<reference>&& value) NOEXCEPT {
+      current = std::addressof(value);
+      return {};
+    }
+    void return_void() const NOEXCEPT { }
+    void unhandled_exception() NOEXCEPT
+    { error = std::current_exception(); }
+    void await_transform() = delete;
+
+    std::add_pointer_t<reference> current = nullptr;
+    std::exception_ptr error;
+  };
+
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  class iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = Generator::value_type;
+
+    iterator() = default;
+    explicit iterator(handle_type handle) NOEXCEPT : handle_(handle) { }
+
+    reference operator*() const NOEXCEPT
+    { return static_cast<reference>(*handle_.promise().current); }
+
+    iterator& operator++() {
+      handle_.resume();
+      Generator::rethrow(handle_);
+      return *this;
+    }
+    void operator++(int) { ++*this; }
+
+    friend bool operator==(const iterator& it, std::default_sentinel_t)
+     NOEXCEPT { return !it.handle_ || it.handle_.done(); }
+
+  private:
+    handle_type handle_ = nullptr;
+  };
+
+public:
+  Generator() = default;
+  Generator(Generator&& other) NOEXCEPT
+   : handle_(std::exchange(other.handle_, nullptr)) { }
+  Generator& operator=(Generator&& other) NOEXCEPT {
+    if(this != &other) {
+      if(handle_)
+        handle_.destroy();
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+  }
+  ~Generator() {
+    if(handle_)
+      handle_.destroy();
+  }
+
+  /// Runs to the first `co_yield`, only call once.
+  iterator begin() {
+    if(handle_) {
+      handle_.resume();
+      Generator::rethrow(handle_);
+    }
+    return iterator(handle_);
+  }
+  std::default_sentinel_t end() const NOEXCEPT { return {}; }
+
+private:
+  explicit Generator(handle_type handle) NOEXCEPT : handle_(handle) { }
+
+  static void rethrow(handle_type handle) {
+    if(handle.promise().error)
+      std::rethrow_exception(std::exchange(handle.promise().error, nullptr));
+  }
+
+private:
+  handle_type handle_ = nullptr;
+};
+
+namespace H {
+  /// The driver coroutine used by `syncWait`, signals when done.
+  struct SyncWaiter {
+    struct promise_type : PooledPromise {
+      SyncWaiter get_return_object() NOEXCEPT {
+        return SyncWaiter {
+          std::coroutine_handle<promise_type>::from_promise(*this) };
+      }
+      std::suspend_always initial_suspend() const NOEXCEPT { return {}; }
+      struct Signal {
+        bool await_ready() const NOEXCEPT { return false; }
+        void await_suspend(
+         std::coroutine_handle<promise_type> self) const NOEXCEPT {
+          std::atomic<std::uint32_t>* const done = self.promise().done;
+          done->store(1, std::memory_order_release);
+          atomicNotifyAll(done);
+        }
+        void await_resume() const NOEXCEPT { }
+      };
+      Signal final_suspend() const NOEXCEPT { return {}; }
+      void return_void() const NOEXCEPT { }
+      void unhandled_exception() const NOEXCEPT { std::terminate(); }
+
+      std::atomic<std::uint32_t>* done = nullptr;
+    };
+
+    std::coroutine_handle<promise_type> handle;
+  };
+
+  template <typename T>
+  struct LaunchAwaiter {
+    bool await_ready() const NOEXCEPT { return false; }
+    std::coroutine_handle<> await_suspend(
+     std::coroutine_handle<> caller) NOEXCEPT
+    { return task.launch(caller); }
+    void await_resume() const NOEXCEPT { }
+    Task<T>& task;
+  };
+
+  /// Leaves the result in `task`, so `syncWait` can take it after.
+  template <typename T>
+  SyncWaiter awaitTask(Task<T>& task) {
+    co_await LaunchAwaiter<T> { task };
+  }
+} // namespace H
+
+/**
+ * Runs `task` to completion on the calling thread, blocking
+ * while it's suspended on work resumed elsewhere.
+ */
+template <typename T>
+T syncWait(Task<T> task) {
+  std::atomic<std::uint32_t> done { 0 };
+  H::SyncWaiter waiter = H::awaitTask(task);
+  waiter.handle.promise().done = &done;
+  waiter.handle.resume();
+  while(done.load(std::memory_order_acquire) == 0)
+    atomicWait(&done, 0);
+  waiter.handle.destroy();
+  return task.result();
+}
+
+} // namespace config
+} // namespace efl
+
+#endif // EFL_HAS_COROUTINES
+
+#endif // EFL_CORO_HPP
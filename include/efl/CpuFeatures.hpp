@@ -0,0 +1,146 @@
+//===- efl/CpuFeatures.hpp ------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides runtime ISA extension detection.
+//  The `EFL_ARCH_HAS_*` macros are what the build targets,
+//  `CpuFeatures` is what the running CPU actually supports.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_CPUFEATURES_HPP
+#define EFL_CPUFEATURES_HPP
+
+#include <efl/Config.hpp>
+
+#if defined(ARCH_AMD) || defined(ARCH_x86)
+# if defined(COMPILER_MSVC)
+#  include <intrin.h>
+# else
+#  include <cpuid.h>
+# endif
+# define EFLI_CPUFEATURES_X86_ 1
+#elif defined(ARCH_ARM64)
+# if defined(PLATFORM_LINUX) || defined(PLATFORM_ANDROID)
+#  include <sys/auxv.h>
+# elif defined(PLATFORM_WINDOWS)
+#  include <windows.h>
+# endif
+#endif
+
+namespace efl {
+namespace config {
+
+/**
+ * Extensions usable by the running process. Everything enabled at
+ * compile time is always reported, so checks fold away when the
+ * target flags already guarantee them.
+ */
+struct CpuFeatures {
+  bool sse2 = Arch::hasSSE2;
+  bool sse42 = Arch::hasSSE42;
+  bool pclmul = Arch::hasPCLMUL;
+  bool avx2 = Arch::hasAVX2;
+  bool avx512f = Arch::hasAVX512F;
+  bool avx512bw = false;
+  bool vpclmul = false;
+  bool neon = Arch::hasNEON;
+  bool crc32 = Arch::hasCRC32;
+  bool pmull = Arch::hasPMULL;
+
+public:
+  /// The features of the running CPU, detected on first call.
+  static const CpuFeatures& query() {
+    static const CpuFeatures features = CpuFeatures::detect();
+    return features;
+  }
+
+private:
+#if defined(EFLI_CPUFEATURES_X86_)
+  static void cpuid(unsigned leaf, unsigned sub, unsigned (&regs)[4]) {
+# if defined(COMPILER_MSVC)
+    int out[4];
+    __cpuidex(out, int(leaf), int(sub));
+    for(int i = 0; i < 4; ++i)
+      regs[i] = unsigned(out[i]);
+# else
+    __cpuid_count(leaf, sub, regs[0], regs[1], regs[2], regs[3]);
+# endif
+  }
+
+  /// Which register states the OS saves on context switches.
+  static unsigned long long xgetbv() {
+# if defined(COMPILER_MSVC)
+    return _xgetbv(0);
+# else
+    unsigned lo, hi;
+    __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (static_cast<unsigned long long>(hi) << 32) | lo;
+# endif
+  }
+#endif // EFLI_CPUFEATURES_X86_
+
+  static CpuFeatures detect() {
+    CpuFeatures out;
+#if defined(EFLI_CPUFEATURES_X86_)
+    unsigned regs[4];
+    cpuid(0, 0, regs);
+    const unsigned maxLeaf = regs[0];
+    if(maxLeaf < 1)
+      return out;
+    cpuid(1, 0, regs);
+    out.sse2 |= (regs[3] >> 26) & 1;
+    out.sse42 |= (regs[2] >> 20) & 1;
+    out.pclmul |= (regs[2] >> 1) & 1;
+    // AVX needs the OS to save ymm (and zmm) state, not just the cpuid bit.
+    const bool osxsave = (regs[2] >> 27) & 1;
+    const unsigned long long xcr0 = osxsave ? xgetbv() : 0;
+    const bool ymm = (xcr0 & 0x6) == 0x6;
+    const bool zmm = (xcr0 & 0xE6) == 0xE6;
+    if(maxLeaf < 7)
+      return out;
+    cpuid(7, 0, regs);
+    out.avx2 |= ymm && ((regs[1] >> 5) & 1);
+    out.avx512f |= zmm && ((regs[1] >> 16) & 1);
+    out.avx512bw = out.avx512f && ((regs[1] >> 30) & 1);
+    out.vpclmul = ymm && ((regs[2] >> 10) & 1);
+#elif defined(ARCH_ARM64)
+# if defined(PLATFORM_LINUX) || defined(PLATFORM_ANDROID)
+    // From <asm/hwcap.h>, which not every libc exposes.
+    const unsigned long hwcap = getauxval(AT_HWCAP);
+    out.neon |= (hwcap >> 1) & 1;
+    out.pmull |= (hwcap >> 4) & 1;
+    out.crc32 |= (hwcap >> 7) & 1;
+# elif defined(PLATFORM_WINDOWS)
+    out.neon = true;
+    out.crc32 |= !!IsProcessorFeaturePresent(PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE);
+    out.pmull |= !!IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE);
+# elif defined(PLATFORM_APPLE)
+    // Every Apple arm64 core has these.
+    out.neon = out.crc32 = out.pmull = true;
+# endif
+#endif
+    return out;
+  }
+};
+
+} // namespace config
+} // namespace efl
+
+#undef EFLI_CPUFEATURES_X86_
+
+#endif // EFL_CPUFEATURES_HPP
@@ -0,0 +1,351 @@
+//===- efl/Crc32c.hpp -----------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides CRC-32C (Castagnoli), as used by iSCSI, ext4...
+//  Uses the `crc32` instructions and carry-less multiply when the
+//  build or the running CPU has them, slice-by-8 tables otherwise.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_CRC32C_HPP
+#define EFL_CRC32C_HPP
+
+#include <efl/CpuFeatures.hpp>
+#include <cstdint>
+#include <cstring>
+
+#if defined(ARCH_AMD64) && (defined(__GNUC__) || defined(EFLI_MSVC_))
+# include <immintrin.h>
+# define EFLI_CRC_X86_ 1
+# define EFLI_CRC_CLMUL_ 1
+# if defined(__GNUC__)
+// Lets the hardware paths be dispatched to at runtime.
+#  define EFLI_CRC_TARGET_ __attribute__((target("sse4.2,pclmul")))
+# else
+#  define EFLI_CRC_TARGET_
+# endif
+#elif defined(ARCH_ARM64) && EFL_ARCH_HAS_CRC32
+# include <arm_acle.h>
+# if EFL_ARCH_HAS_PMULL
+#  include <arm_neon.h>
+#  define EFLI_CRC_CLMUL_ 1
+# endif
+# define EFLI_CRC_ARM_ 1
+# define EFLI_CRC_TARGET_
+#endif
+
+namespace efl {
+namespace config {
+namespace H {
+  /// The reflected Castagnoli polynomial.
+  constexpr std::uint32_t crc32cPoly = 0x82F63B78u;
+  /// Bytes per lane when three lanes are interleaved.
+  constexpr inl_szt_ crc32cBlock = 8192;
+  /// Below this, folding doesn't pay for its setup.
+  constexpr inl_szt_ crc32cFoldMin = 256;
+
+  /**
+   * `a * b` modulo the polynomial. Values are reflected like the
+   * CRC itself, so `1 << 31` is `x^0`.
+   */
+  inline std::uint32_t crc32cMulMod(std::uint32_t a, std::uint32_t b) NOEXCEPT {
+    std::uint32_t out = 0;
+    for(std::uint32_t m = 1u << 31; m && a; m >>= 1) {
+      if(a & m) {
+        out ^= b;
+        a ^= m;
+      }
+      b = (b & 1) ? ((b >> 1) ^ crc32cPoly) : (b >> 1);
+    }
+    return out;
+  }
+
+  /// `x^n` modulo the polynomial.
+  inline std::uint32_t crc32cPowMod(std::uint64_t n) NOEXCEPT {
+    // x^(2^k) for every k, so a power costs popcount(n) multiplies.
+    struct Squares { std::uint32_t at[64]; };
+    static const Squares squares = []() -> Squares {
+      Squares out;
+      out.at[0] = 1u << 30;
+      for(int k = 1; k < 64; ++k)
+        out.at[k] = crc32cMulMod(out.at[k - 1], out.at[k - 1]);
+      return out;
+    }();
+    std::uint32_t out = 1u << 31;
+    for(int k = 0; n; n >>= 1, ++k) {
+      if(n & 1)
+        out = crc32cMulMod(out, squares.at[k]);
+    }
+    return out;
+  }
+
+  struct Crc32cTables { std::uint32_t t[8][256]; };
+
+  inline const Crc32cTables& crc32cTables() {
+    static const Crc32cTables tables = []() -> Crc32cTables {
+      Crc32cTables out;
+      for(std::uint32_t i = 0; i < 256; ++i) {
+        std::uint32_t crc = i;
+        for(int bit = 0; bit < 8; ++bit)
+          crc = (crc & 1) ? ((crc >> 1) ^ crc32cPoly) : (crc >> 1);
+        out.t[0][i] = crc;
+      }
+      for(int k = 1; k < 8; ++k) {
+        for(int i = 0; i < 256; ++i) {
+          const std::uint32_t prev = out.t[k - 1][i];
+          out.t[k][i] = (prev >> 8) ^ out.t[0][prev & 0xFF];
+        }
+      }
+      return out;
+    }();
+    return tables;
+  }
+
+  /// Slice-by-8, `crc` is the raw (uninverted) state.
+  inline std::uint32_t crc32cSoftware(std::uint32_t crc,
+   const unsigned char* p, inl_szt_ n) NOEXCEPT {
+    const auto& t = crc32cTables().t;
+    for(; n && (reinterpret_cast<std::uintptr_t>(p) & 7); --n)
+      crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    for(; n >= 8; n -= 8, p += 8) {
+      // Assembled bytewise to stay endian agnostic, folds to a load.
+      const std::uint32_t lo = crc ^ (std::uint32_t(p[0])
+        | (std::uint32_t(p[1]) << 8) | (std::uint32_t(p[2]) << 16)
+        | (std::uint32_t(p[3]) << 24));
+      const std::uint32_t hi = std::uint32_t(p[4])
+        | (std::uint32_t(p[5]) << 8) | (std::uint32_t(p[6]) << 16)
+        | (std::uint32_t(p[7]) << 24);
+      crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF]
+        ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+        ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF]
+        ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    }
+    for(; n; --n)
+      crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc;
+  }
+
+  /**
+   * Folding a 128-bit chunk forward `D` bits multiplies its low lane
+   * by `x^(D+63)` and its high lane by `x^(D-1)`, placed in the high
+   * half of a 64-bit lane as carry-less multiplies expect.
+   * `shift` moves a lane CRC past the lanes after it.
+   */
+  struct Crc32cKeys {
+    std::uint64_t fold4[2];
+    std::uint64_t fold1[2];
+    std::uint32_t shift[2];
+  };
+
+  inline const Crc32cKeys& crc32cKeys() {
+    static const Crc32cKeys keys = []() -> Crc32cKeys {
+      const auto fold = [](std::uint64_t bits, std::uint64_t (&out)[2]) {
+        out[0] = std::uint64_t(crc32cPowMod(bits + 63)) << 32;
+        out[1] = std::uint64_t(crc32cPowMod(bits - 1)) << 32;
+      };
+      Crc32cKeys out;
+      fold(512, out.fold4);
+      fold(128, out.fold1);
+      out.shift[0] = crc32cPowMod(std::uint64_t(crc32cBlock) * 16);
+      out.shift[1] = crc32cPowMod(std::uint64_t(crc32cBlock) * 8);
+      return out;
+    }();
+    return keys;
+  }
+
+#if defined(EFLI_CRC_X86_) || defined(EFLI_CRC_ARM_)
+  ALWAYS_INLINE std::uint64_t crcLoad64(const unsigned char* p) NOEXCEPT {
+    std::uint64_t out;
+    std::memcpy(&out, p, sizeof(out));
+    return out;
+  }
+
+# if defined(EFLI_CRC_X86_)
+  typedef __m128i CrcReg;
+  ALWAYS_INLINE EFLI_CRC_TARGET_
+  std::uint32_t crcByte(std::uint32_t crc, unsigned char byte) NOEXCEPT
+  { return _mm_crc32_u8(crc, byte); }
+  ALWAYS_INLINE EFLI_CRC_TARGET_
+  std::uint32_t crcWord(std::uint32_t crc, std::uint64_t word) NOEXCEPT
+  { return std::uint32_t(_mm_crc32_u64(crc, word)); }
+  ALWAYS_INLINE EFLI_CRC_TARGET_
+  CrcReg crcLoad(const unsigned char* p) NOEXCEPT
+  { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+  ALWAYS_INLINE EFLI_CRC_TARGET_
+  CrcReg crcMake(std::uint64_t lo, std::uint64_t hi) NOEXCEPT
+  { return _mm_set_epi64x(static_cast<long long>(hi), static_cast<long long>(lo)); }
+  ALWAYS_INLINE EFLI_CRC_TARGET_
+  CrcReg crcXor(CrcReg a, CrcReg b) NOEXCEPT { return _mm_xor_si128(a, b); }
+  ALWAYS_INLINE EFLI_CRC_TARGET_
+  std::uint64_t crcLow(CrcReg x) NOEXCEPT
+  { return std::uint64_t(_mm_cvtsi128_si64(x)); }
+  ALWAYS_INLINE EFLI_CRC_TARGET_
+  std::uint64_t crcHigh(CrcReg x) NOEXCEPT
+  { return std::uint64_t(_mm_extract_epi64(x, 1)); }
+  /// Low lane times low key, high lane times high key.
+  ALWAYS_INLINE EFLI_CRC_TARGET_
+  CrcReg crcFold(CrcReg x, CrcReg keys) NOEXCEPT {
+    return _mm_xor_si128(_mm_clmulepi64_si128(x, keys, 0x00),
+      _mm_clmulepi64_si128(x, keys, 0x11));
+  }
+# else
+  ALWAYS_INLINE std::uint32_t crcByte(std::uint32_t crc, unsigned char byte) NOEXCEPT
+  { return __crc32cb(crc, byte); }
+  ALWAYS_INLINE std::uint32_t crcWord(std::uint32_t crc, std::uint64_t word) NOEXCEPT
+  { return __crc32cd(crc, word); }
+#  if defined(EFLI_CRC_CLMUL_)
+  typedef uint64x2_t CrcReg;
+  ALWAYS_INLINE CrcReg crcLoad(const unsigned char* p) NOEXCEPT
+  { return vreinterpretq_u64_u8(vld1q_u8(p)); }
+  ALWAYS_INLINE CrcReg crcMake(std::uint64_t lo, std::uint64_t hi) NOEXCEPT
+  { return vcombine_u64(vcreate_u64(lo), vcreate_u64(hi)); }
+  ALWAYS_INLINE CrcReg crcXor(CrcReg a, CrcReg b) NOEXCEPT { return veorq_u64(a, b); }
+  ALWAYS_INLINE std::uint64_t crcLow(CrcReg x) NOEXCEPT { return vgetq_lane_u64(x, 0); }
+  ALWAYS_INLINE std::uint64_t crcHigh(CrcReg x) NOEXCEPT { return vgetq_lane_u64(x, 1); }
+  ALWAYS_INLINE CrcReg crcFold(CrcReg x, CrcReg keys) NOEXCEPT {
+    const poly128_t lo = vmull_p64(crcLow(x), crcLow(keys));
+    const poly128_t hi = vmull_high_p64(
+      vreinterpretq_p64_u64(x), vreinterpretq_p64_u64(keys));
+    return veorq_u64(vreinterpretq_u64_p128(lo), vreinterpretq_u64_p128(hi));
+  }
+#  endif
+# endif
+
+# if defined(EFLI_CRC_CLMUL_)
+  /**
+   * Folds four 128-bit accumulators 64 bytes at a time, then
+   * reduces what's left with two `crc32`s. Roughly twice as fast
+   * as the interleaved lanes, and needs no long blocks to get there.
+   */
+  EFLI_CRC_TARGET_ inline std::uint32_t crc32cFold(std::uint32_t crc,
+   const unsigned char*& p, inl_szt_& n) NOEXCEPT {
+    const Crc32cKeys& keys = crc32cKeys();
+    CrcReg x0 = crcXor(crcLoad(p), crcMake(crc, 0));
+    CrcReg x1 = crcLoad(p + 16);
+    CrcReg x2 = crcLoad(p + 32);
+    CrcReg x3 = crcLoad(p + 48);
+    p += 64, n -= 64;
+
+    const CrcReg k4 = crcMake(keys.fold4[0], keys.fold4[1]);
+    for(; n >= 64; n -= 64, p += 64) {
+      x0 = crcXor(crcFold(x0, k4), crcLoad(p));
+      x1 = crcXor(crcFold(x1, k4), crcLoad(p + 16));
+      x2 = crcXor(crcFold(x2, k4), crcLoad(p + 32));
+      x3 = crcXor(crcFold(x3, k4), crcLoad(p + 48));
+    }
+
+    const CrcReg k1 = crcMake(keys.fold1[0], keys.fold1[1]);
+    x0 = crcXor(crcFold(x0, k1), x1);
+    x0 = crcXor(crcFold(x0, k1), x2);
+    x0 = crcXor(crcFold(x0, k1), x3);
+    for(; n >= 16; n -= 16, p += 16)
+      x0 = crcXor(crcFold(x0, k1), crcLoad(p));
+    return crcWord(crcWord(0, crcLow(x0)), crcHigh(x0));
+  }
+# endif // EFLI_CRC_CLMUL_
+
+  /**
+   * Runs three independent lanes, hiding the `crc32` latency
+   * (3 cycles, 1 per cycle throughput). Lanes are long enough
+   * that merging them in software is noise.
+   */
+  EFLI_CRC_TARGET_ inline std::uint32_t crc32cInterleave(std::uint32_t crc,
+   const unsigned char*& p, inl_szt_& n) NOEXCEPT {
+    constexpr inl_szt_ block = crc32cBlock;
+    const Crc32cKeys& keys = crc32cKeys();
+    for(; n >= block * 3; n -= block * 3) {
+      std::uint32_t a = crc, b = 0, c = 0;
+      for(const unsigned char* end = p + block; p != end; p += 8) {
+        a = crcWord(a, crcLoad64(p));
+        b = crcWord(b, crcLoad64(p + block));
+        c = crcWord(c, crcLoad64(p + block * 2));
+      }
+      crc = crc32cMulMod(keys.shift[0], a) ^ crc32cMulMod(keys.shift[1], b) ^ c;
+      p += block * 2;
+    }
+    return crc;
+  }
+
+  template <bool Clmul>
+  EFLI_CRC_TARGET_ inline std::uint32_t crc32cHardware(std::uint32_t crc,
+   const unsigned char* p, inl_szt_ n) NOEXCEPT {
+    for(; n && (reinterpret_cast<std::uintptr_t>(p) & 7); --n)
+      crc = crcByte(crc, *p++);
+#if defined(EFLI_CRC_CLMUL_)
+    if(Clmul) {
+      if(n >= crc32cFoldMin)
+        crc = crc32cFold(crc, p, n);
+    } else
+#endif
+      crc = crc32cInterleave(crc, p, n);
+    for(; n >= 8; n -= 8, p += 8)
+      crc = crcWord(crc, crcLoad64(p));
+    for(; n; --n)
+      crc = crcByte(crc, *p++);
+    return crc;
+  }
+#endif // EFLI_CRC_X86_ || EFLI_CRC_ARM_
+
+  inline std::uint32_t crc32cRaw(std::uint32_t crc,
+   const unsigned char* p, inl_szt_ n) NOEXCEPT {
+#if defined(EFLI_CRC_X86_) && EFL_ARCH_HAS_SSE42 && EFL_ARCH_HAS_PCLMUL
+    return crc32cHardware<true>(crc, p, n);
+#elif defined(EFLI_CRC_ARM_)
+    return crc32cHardware<EFL_ARCH_HAS_PMULL != 0>(crc, p, n);
+#elif defined(EFLI_CRC_X86_)
+    typedef std::uint32_t(*Impl)(std::uint32_t, const unsigned char*, inl_szt_);
+    static const Impl impl = []() -> Impl {
+      const CpuFeatures& features = CpuFeatures::query();
+      if(features.sse42 && features.pclmul)
+        return &crc32cHardware<true>;
+      else if(features.sse42)
+        return &crc32cHardware<false>;
+      return &crc32cSoftware;
+    }();
+    return impl(crc, p, n);
+#else
+    return crc32cSoftware(crc, p, n);
+#endif
+  }
+} // namespace H
+
+/**
+ * CRC-32C of `size` bytes. Pass a previous result as `seed` to
+ * continue it, `crc32c(b, nb, crc32c(a, na))` covers `a` then `b`.
+ */
+inline std::uint32_t crc32c(const void* data,
+ H::inl_szt_ size, std::uint32_t seed = 0) NOEXCEPT {
+  return ~H::crc32cRaw(~seed,
+    static_cast<const unsigned char*>(data), size);
+}
+
+/// The CRC-32C of `a` then `b`, given both CRCs and the size of `b`.
+inline std::uint32_t crc32cCombine(std::uint32_t crcA,
+ std::uint32_t crcB, H::inl_szt_ sizeB) NOEXCEPT {
+  return H::crc32cMulMod(H::crc32cPowMod(std::uint64_t(sizeB) * 8), crcA) ^ crcB;
+}
+
+} // namespace config
+} // namespace efl
+
+#undef EFLI_CRC_X86_
+#undef EFLI_CRC_ARM_
+#undef EFLI_CRC_CLMUL_
+#undef EFLI_CRC_TARGET_
+
+#endif // EFL_CRC32C_HPP
@@ -0,0 +1,184 @@
+//===- efl/Dispatch.hpp ---------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides threaded dispatch for bytecode interpreters.
+//  Picks guaranteed tail calls or computed goto when the compiler
+//  has them, otherwise falls back to a switch loop.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_DISPATCH_HPP
+#define EFL_DISPATCH_HPP
+
+#include <efl/Config.hpp>
+#include <cstddef>
+#include <type_traits>
+
+// Calls `m(hi, lo)` for every pair of hex digits, 0x00 to 0xFF.
+#define EFLI_DISPATCH_X16_(m, hi) \
+  m(hi, 0) m(hi, 1) m(hi, 2) m(hi, 3) m(hi, 4) m(hi, 5) m(hi, 6) m(hi, 7) \
+  m(hi, 8) m(hi, 9) m(hi, A) m(hi, B) m(hi, C) m(hi, D) m(hi, E) m(hi, F)
+#define EFLI_DISPATCH_X256_(m) \
+  EFLI_DISPATCH_X16_(m, 0) EFLI_DISPATCH_X16_(m, 1) \
+  EFLI_DISPATCH_X16_(m, 2) EFLI_DISPATCH_X16_(m, 3) \
+  EFLI_DISPATCH_X16_(m, 4) EFLI_DISPATCH_X16_(m, 5) \
+  EFLI_DISPATCH_X16_(m, 6) EFLI_DISPATCH_X16_(m, 7) \
+  EFLI_DISPATCH_X16_(m, 8) EFLI_DISPATCH_X16_(m, 9) \
+  EFLI_DISPATCH_X16_(m, A) EFLI_DISPATCH_X16_(m, B) \
+  EFLI_DISPATCH_X16_(m, C) EFLI_DISPATCH_X16_(m, D) \
+  EFLI_DISPATCH_X16_(m, E) EFLI_DISPATCH_X16_(m, F)
+
+#define EFLI_DISPATCH_CASE_(hi, lo) \
+  case 0x##hi##lo: \
+    if(!step<0x##hi##lo>(ctx)) return; \
+    break;
+#define EFLI_DISPATCH_LABEL_(hi, lo) &&efli_op_##hi##lo,
+#define EFLI_DISPATCH_BLOCK_(hi, lo) \
+  efli_op_##hi##lo: \
+    if(!step<0x##hi##lo>(ctx)) return; \
+    goto *labels[static_cast<unsigned char>(ctx.fetch())];
+#define EFLI_DISPATCH_TAIL_(hi, lo) &tailOp<0x##hi##lo>,
+
+#if EFL_HAS_COMPUTED_GOTO
+// Labels as values are a GNU extension, so silence `-Wpedantic`.
+# define EFLI_DISPATCH_GNU_BEGIN_ \
+  EFL_COMPILER_PRAGMA(GCC diagnostic push) \
+  EFL_COMPILER_PRAGMA(GCC diagnostic ignored "-Wpedantic")
+# define EFLI_DISPATCH_GNU_END_ \
+  EFL_COMPILER_PRAGMA(GCC diagnostic pop)
+#else
+# define EFLI_DISPATCH_GNU_BEGIN_
+# define EFLI_DISPATCH_GNU_END_
+#endif
+
+namespace efl {
+namespace config {
+
+enum class DispatchKind {
+  SWITCH,
+  COMPUTED_GOTO,
+  TAIL_CALL,
+};
+
+/**
+ * Runs a bytecode loop over `Ctx`, which provides:
+ *   `unsigned fetch()`, the next opcode (truncated to a byte).
+ *   `template <std::size_t Op> bool execute()`, runs `Op` and
+ *     returns false to stop.
+ * Opcodes at or above `N` stop the loop without calling `execute`.
+ * Threaded kinds give every opcode its own indirect branch, which
+ * predicts far better than the single shared one of a switch.
+ * `execute` should be `ALWAYS_INLINE`, it is expanded per opcode.
+ */
+template <class Ctx, std::size_t N = 256>
+struct ThreadedDispatch {
+  static_assert(N > 0 && N <= 256, "Opcodes must fit in a byte.");
+
+  /// The fastest kind this compiler can guarantee.
+  static constexpr DispatchKind best =
+    EFL_HAS_MUSTTAIL ? DispatchKind::TAIL_CALL :
+    EFL_HAS_COMPUTED_GOTO ? DispatchKind::COMPUTED_GOTO :
+    DispatchKind::SWITCH;
+
+  /// Runs until an opcode returns false. Unsupported kinds use `SWITCH`.
+  template <DispatchKind Kind = best>
+  static void run(Ctx& ctx) {
+    runKind(ctx, std::integral_constant<DispatchKind, Kind>{});
+  }
+
+private:
+  template <std::size_t Op>
+  ALWAYS_INLINE static bool step(Ctx& ctx, std::true_type) {
+    return ctx.template execute<Op>();
+  }
+
+  template <std::size_t>
+  ALWAYS_INLINE static bool step(Ctx&, std::false_type) {
+    return false;
+  }
+
+  template <std::size_t Op>
+  ALWAYS_INLINE static bool step(Ctx& ctx) {
+    return step<Op>(ctx, std::integral_constant<bool, (Op < N)>{});
+  }
+
+  static void runKind(Ctx& ctx,
+   std::integral_constant<DispatchKind, DispatchKind::SWITCH>) {
+    for(;;) {
+      switch(static_cast<unsigned char>(ctx.fetch())) {
+        EFLI_DISPATCH_X256_(EFLI_DISPATCH_CASE_)
+      }
+    }
+  }
+
+EFLI_DISPATCH_GNU_BEGIN_
+  static void runKind(Ctx& ctx,
+   std::integral_constant<DispatchKind, DispatchKind::COMPUTED_GOTO>) {
+#if EFL_HAS_COMPUTED_GOTO
+    static void* const labels[256] = {
+      EFLI_DISPATCH_X256_(EFLI_DISPATCH_LABEL_)
+    };
+    goto *labels[static_cast<unsigned char>(ctx.fetch())];
+    EFLI_DISPATCH_X256_(EFLI_DISPATCH_BLOCK_)
+#else
+    runKind(ctx, std::integral_constant<DispatchKind, DispatchKind::SWITCH>{});
+#endif
+  }
+EFLI_DISPATCH_GNU_END_
+
+#if EFL_HAS_MUSTTAIL
+  typedef void(*TailOp)(Ctx&);
+
+  static const TailOp* tailOps() {
+    static const TailOp ops[256] = {
+      EFLI_DISPATCH_X256_(EFLI_DISPATCH_TAIL_)
+    };
+    return ops;
+  }
+
+  template <std::size_t Op>
+  static void tailOp(Ctx& ctx) {
+    if(!step<Op>(ctx))
+      return;
+    EFL_MUSTTAIL return tailOps()[static_cast<unsigned char>(ctx.fetch())](ctx);
+  }
+#endif
+
+  static void runKind(Ctx& ctx,
+   std::integral_constant<DispatchKind, DispatchKind::TAIL_CALL>) {
+#if EFL_HAS_MUSTTAIL
+    tailOps()[static_cast<unsigned char>(ctx.fetch())](ctx);
+#else
+    runKind(ctx, std::integral_constant<DispatchKind, DispatchKind::SWITCH>{});
+#endif
+  }
+};
+
+} // namespace config
+} // namespace efl
+
+#undef EFLI_DISPATCH_X16_
+#undef EFLI_DISPATCH_X256_
+#undef EFLI_DISPATCH_CASE_
+#undef EFLI_DISPATCH_LABEL_
+#undef EFLI_DISPATCH_BLOCK_
+#undef EFLI_DISPATCH_TAIL_
+#undef EFLI_DISPATCH_GNU_BEGIN_
+#undef EFLI_DISPATCH_GNU_END_
+
+#endif // EFL_DISPATCH_HPP
@@ -0,0 +1,126 @@
+//===- efl/FloatEnv.hpp ---------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides control over the floating point environment.
+//  Currently only denormal flushing, which isn't covered by <cfenv>.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_FLOATENV_HPP
+#define EFL_FLOATENV_HPP
+
+#include <efl/Config.hpp>
+#include <cstdint>
+
+#if (defined(ARCH_AMD64) || defined(ARCH_x86_32)) && EFL_ARCH_HAS_SSE2
+# include <immintrin.h>
+// MXCSR: flush-to-zero (bit 15) and denormals-are-zero (bit 6).
+# define EFLI_FLOATENV_MXCSR_ 1
+#elif defined(ARCH_ARM64) && !defined(COMPILER_MSVC)
+// FPCR.FZ (bit 24), covers both inputs and outputs.
+# define EFLI_FLOATENV_FPCR_ 1
+#elif defined(ARCH_ARM) && defined(__ARM_FP) && !defined(COMPILER_MSVC)
+// FPSCR.FZ (bit 24), same as AArch64.
+# define EFLI_FLOATENV_FPSCR_ 1
+#endif
+
+namespace efl {
+namespace config {
+namespace H {
+#if defined(EFLI_FLOATENV_MXCSR_)
+  typedef unsigned FpControl;
+  constexpr FpControl fpFlushBits = 0x8040;
+  ALWAYS_INLINE FpControl readFpControl() NOEXCEPT { return _mm_getcsr(); }
+  ALWAYS_INLINE void writeFpControl(FpControl value) NOEXCEPT { _mm_setcsr(value); }
+#elif defined(EFLI_FLOATENV_FPCR_)
+  typedef std::uint64_t FpControl;
+  constexpr FpControl fpFlushBits = FpControl(1) << 24;
+  ALWAYS_INLINE FpControl readFpControl() NOEXCEPT {
+    FpControl value;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(value));
+    return value;
+  }
+  ALWAYS_INLINE void writeFpControl(FpControl value) NOEXCEPT {
+    __asm__ __volatile__("msr fpcr, %0" :: "r"(value) : "memory");
+  }
+#elif defined(EFLI_FLOATENV_FPSCR_)
+  typedef std::uint32_t FpControl;
+  constexpr FpControl fpFlushBits = FpControl(1) << 24;
+  ALWAYS_INLINE FpControl readFpControl() NOEXCEPT {
+    FpControl value;
+    __asm__ __volatile__("vmrs %0, fpscr" : "=r"(value));
+    return value;
+  }
+  ALWAYS_INLINE void writeFpControl(FpControl value) NOEXCEPT {
+    __asm__ __volatile__("vmsr fpscr, %0" :: "r"(value) : "memory");
+  }
+#else
+  typedef unsigned FpControl;
+  constexpr FpControl fpFlushBits = 0;
+  ALWAYS_INLINE FpControl readFpControl() NOEXCEPT { return 0; }
+  ALWAYS_INLINE void writeFpControl(FpControl) NOEXCEPT { }
+#endif
+} // namespace H
+
+/**
+ * Treats denormal floats as zero until the end of the scope.
+ * Arithmetic on denormals takes a microcode assist on most cores
+ * (often 100x slower), so use this around DSP or ML kernels
+ * whose values may decay towards zero.
+ * The control register is per thread, so only the current thread
+ * is affected (threads it starts in the scope may inherit the
+ * setting, Linux copies it on creation).
+ * On exit the flush bits are restored to what they
+ * were, other changes made in the scope (eg. rounding) are kept.
+ * A no-op on targets without a flush mode (or x87 math).
+ */
+class FlushDenormalsScope {
+public:
+  FlushDenormalsScope() NOEXCEPT : saved_(H::readFpControl()) {
+    H::writeFpControl(saved_ | H::fpFlushBits);
+  }
+
+  FlushDenormalsScope(const FlushDenormalsScope&) = delete;
+  FlushDenormalsScope& operator=(const FlushDenormalsScope&) = delete;
+
+  ~FlushDenormalsScope() {
+    const H::FpControl current = H::readFpControl();
+    H::writeFpControl((current & ~H::fpFlushBits) | (saved_ & H::fpFlushBits));
+  }
+
+  /// If this target can flush denormals at all.
+  static constexpr bool isSupported() NOEXCEPT { return H::fpFlushBits != 0; }
+
+  /// If denormals are currently flushed on this thread.
+  static bool isActive() NOEXCEPT {
+    return isSupported() &&
+      (H::readFpControl() & H::fpFlushBits) == H::fpFlushBits;
+  }
+
+private:
+  H::FpControl saved_;
+};
+
+} // namespace config
+} // namespace efl
+
+#undef EFLI_FLOATENV_MXCSR_
+#undef EFLI_FLOATENV_FPCR_
+#undef EFLI_FLOATENV_FPSCR_
+
+#endif // EFL_FLOATENV_HPP
@@ -0,0 +1,537 @@
+//===- efl/Io.hpp ---------------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides awaitable file I/O, batched through io_uring
+//  on Linux, or a blocking thread pool elsewhere.
+//  Needs coroutines and POSIX file descriptors.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_IO_HPP
+#define EFL_IO_HPP
+
+#include <efl/Coro.hpp>
+
+#if EFL_HAS_COROUTINES && !defined(PLATFORM_WINDOWS)
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(PLATFORM_LINUX) && __has_include(<linux/io_uring.h>)
+# include <linux/io_uring.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# if defined(SYS_io_uring_setup)
+#  define EFLI_IO_URING_ 1
+# endif
+#endif
+
+namespace efl {
+namespace config {
+namespace H {
+  /// A fire-and-forget coroutine, frees itself when done.
+  struct Detached {
+    struct promise_type : PooledPromise {
+      Detached get_return_object() const NOEXCEPT { return {}; }
+      std::suspend_never initial_suspend() const NOEXCEPT { return {}; }
+      std::suspend_never final_suspend() const NOEXCEPT { return {}; }
+      void return_void() const NOEXCEPT { }
+      void unhandled_exception() const NOEXCEPT { std::terminate(); }
+    };
+  };
+} // namespace H
+
+namespace io {
+
+class Executor;
+
+enum class Backend {
+  URING,    ///< Batched through io_uring.
+  THREADS,  ///< Blocking calls on a small thread pool.
+};
+
+/**
+ * One pending operation, awaited in place. The result is
+ * the byte count (0 for `fsync`), or a negative `errno`.
+ */
+class Op {
+  friend class Executor;
+
+public:
+  enum class Kind { READ, WRITE, FSYNC, READ_FIXED, WRITE_FIXED };
+
+  bool await_ready() const NOEXCEPT { return false; }
+  void await_suspend(std::coroutine_handle<> caller);
+  std::int64_t await_resume() const NOEXCEPT { return result_; }
+
+private:
+  Op(Executor* exec, Kind kind, int fd, void* buf,
+   H::inl_szt_ len, std::uint64_t offset, unsigned index) NOEXCEPT
+   : exec_(exec), kind_(kind), fd_(fd), offset_(offset), index_(index) {
+    vec_.iov_base = buf;
+    vec_.iov_len = len;
+  }
+
+  /// Runs the operation synchronously, for the thread pool.
+  void perform() NOEXCEPT {
+    ssize_t n = 0;
+    switch(kind_) {
+     case Kind::READ:
+     case Kind::READ_FIXED:
+      n = ::pread(fd_, vec_.iov_base, vec_.iov_len, off_t(offset_));
+      break;
+     case Kind::WRITE:
+     case Kind::WRITE_FIXED:
+      n = ::pwrite(fd_, vec_.iov_base, vec_.iov_len, off_t(offset_));
+      break;
+     case Kind::FSYNC:
+      n = ::fsync(fd_);
+      break;
+    }
+    result_ = (n < 0) ? -std::int64_t(errno) : std::int64_t(n);
+  }
+
+private:
+  Executor* exec_;
+  Kind kind_;
+  int fd_;
+  std::uint64_t offset_;
+  unsigned index_;
+  ::iovec vec_;
+  std::int64_t result_ = 0;
+  std::coroutine_handle<> handle_;
+};
+
+/**
+ * Runs `read`, `write` and `fsync` for coroutines. Awaiting only
+ * queues an operation, they are submitted together by `poll`,
+ * which also resumes completed coroutines on the calling thread.
+ * Not thread-safe, drive each executor from a single thread.
+ * Ops must complete before the executor is destroyed.
+ */
+class Executor {
+  friend class Op;
+
+public:
+  /**
+   * Tries io_uring with `entries` slots unless `backend` is `THREADS`,
+   * falling back to a pool of `threads` workers if the kernel
+   * doesn't support it (or it's blocked, eg. by seccomp).
+   */
+  explicit Executor(unsigned entries = 256, unsigned threads = 4,
+   Backend backend = Backend::URING) {
+#if defined(EFLI_IO_URING_)
+    if(backend == Backend::URING && this->setupRing(entries))
+      return;
+#else
+    (void) entries;
+    (void) backend;
+#endif
+    backend_ = Backend::THREADS;
+    for(unsigned i = 0; i < (threads ? threads : 1); ++i)
+      workers_.emplace_back(&Executor::workerMain, this);
+  }
+
+  Executor(const Executor&) = delete;
+  Executor& operator=(const Executor&) = delete;
+
+  ~Executor() {
+#if defined(EFLI_IO_URING_)
+    if(backend_ == Backend::URING) {
+      this->teardownRing();
+      return;
+    }
+#endif
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for(std::thread& worker : workers_)
+      worker.join();
+  }
+
+  Backend backend() const NOEXCEPT { return backend_; }
+
+  Op read(int fd, void* buf, H::inl_szt_ len, std::uint64_t offset) NOEXCEPT
+  { return Op(this, Op::Kind::READ, fd, buf, len, offset, 0); }
+  Op write(int fd, const void* buf,
+   H::inl_szt_ len, std::uint64_t offset) NOEXCEPT {
+    return Op(this, Op::Kind::WRITE, fd,
+      const_cast<void*>(buf), len, offset, 0);
+  }
+  Op fsync(int fd) NOEXCEPT
+  { return Op(this, Op::Kind::FSYNC, fd, nullptr, 0, 0, 0); }
+
+  /// Reads into registered buffer `index`, `buf` must lie within it.
+  Op readFixed(int fd, void* buf, H::inl_szt_ len,
+   std::uint64_t offset, unsigned index) NOEXCEPT {
+    return Op(this, Op::Kind::READ_FIXED, fd, buf, len, offset, index);
+  }
+  /// Writes from registered buffer `index`, `buf` must lie within it.
+  Op writeFixed(int fd, const void* buf, H::inl_szt_ len,
+   std::uint64_t offset, unsigned index) NOEXCEPT {
+    return Op(this, Op::Kind::WRITE_FIXED, fd,
+      const_cast<void*>(buf), len, offset, index);
+  }
+
+  /**
+   * Pins `count` buffers for the `*Fixed` operations, which skips
+   * per-op page lookups. A no-op on the thread pool.
+   */
+  bool registerBuffers(const ::iovec* buffers, unsigned count) NOEXCEPT {
+#if defined(EFLI_IO_URING_)
+    if(backend_ == Backend::URING) {
+      return ::syscall(SYS_io_uring_register, ring_.fd,
+        IORING_REGISTER_BUFFERS, buffers, count) == 0;
+    }
+#endif
+    (void) buffers;
+    (void) count;
+    return true;
+  }
+
+  bool unregisterBuffers() NOEXCEPT {
+#if defined(EFLI_IO_URING_)
+    if(backend_ == Backend::URING) {
+      return ::syscall(SYS_io_uring_register, ring_.fd,
+        IORING_UNREGISTER_BUFFERS, nullptr, 0) == 0;
+    }
+#endif
+    return true;
+  }
+
+  /// Operations submitted or queued, but not yet resumed.
+  H::inl_szt_ inFlight() const NOEXCEPT { return inFlight_; }
+
+  /**
+   * Submits queued operations and resumes completed ones.
+   * With `wait`, blocks for at least one completion if any are
+   * in flight. Returns the number of coroutines resumed.
+   */
+  H::inl_szt_ poll(bool wait = true) {
+#if defined(EFLI_IO_URING_)
+    if(backend_ == Backend::URING)
+      return this->pollRing(wait);
+#endif
+    return this->pollThreads(wait);
+  }
+
+  /// Runs `task` to completion, polling while it waits on I/O.
+  template <typename T>
+  T run(Task<T> task) {
+    std::atomic<std::uint32_t> done { 0 };
+    H::SyncWaiter waiter = H::awaitTask(task);
+    waiter.handle.promise().done = &done;
+    waiter.handle.resume();
+    while(done.load(std::memory_order_acquire) == 0)
+      (void) this->poll(true);
+    waiter.handle.destroy();
+    return task.result();
+  }
+
+  /**
+   * Starts `task` now, it keeps running as `poll` resumes it.
+   * Spawning many tasks lets their operations share submissions.
+   * Exceptions escaping `task` terminate.
+   */
+  void spawn(Task<> task) {
+    ++spawned_;
+    (void) Executor::detach(this, std::move(task));
+  }
+
+  /// Polls until every spawned task and operation has finished.
+  void drain() {
+    while(spawned_ != 0 || inFlight_ != 0)
+      (void) this->poll(true);
+  }
+
+private:
+  static H::Detached detach(Executor* self, Task<> task) {
+    co_await std::move(task);
+    --self->spawned_;
+  }
+
+  void enqueue(Op* op) {
+    ++inFlight_;
+#if defined(EFLI_IO_URING_)
+    if(backend_ == Backend::URING) {
+      this->pushRing(op);
+      return;
+    }
+#endif
+    staged_.push_back(op);
+  }
+
+  //=== Thread pool ===//
+
+  H::inl_szt_ pollThreads(bool wait) {
+    if(!staged_.empty()) {
+      {
+        std::lock_guard<std::mutex> guard(lock_);
+        queue_.insert(queue_.end(), staged_.begin(), staged_.end());
+      }
+      staged_.clear();
+      wake_.notify_all();
+    }
+    std::vector<Op*> done;
+    for(;;) {
+      const std::uint32_t epoch = epoch_.load(std::memory_order_acquire);
+      {
+        std::lock_guard<std::mutex> guard(lock_);
+        done.swap(completed_);
+      }
+      if(!done.empty() || !wait || inFlight_ == 0)
+        break;
+      atomicWait(&epoch_, epoch);
+    }
+    for(Op* op : done) {
+      --inFlight_;
+      op->handle_.resume();
+    }
+    return done.size();
+  }
+
+  void workerMain() {
+    std::unique_lock<std::mutex> guard(lock_);
+    for(;;) {
+      wake_.wait(guard, [this] { return stop_ || !queue_.empty(); });
+      if(queue_.empty())
+        return;
+      Op* const op = queue_.back();
+      queue_.pop_back();
+      guard.unlock();
+      op->perform();
+      guard.lock();
+      completed_.push_back(op);
+      epoch_.fetch_add(1, std::memory_order_release);
+      atomicNotifyOne(&epoch_);
+    }
+  }
+
+#if defined(EFLI_IO_URING_)
+  //=== io_uring ===//
+
+  struct Ring {
+    int fd = -1;
+    unsigned entries = 0;
+    void* sqMap = nullptr;
+    H::inl_szt_ sqMapSize = 0;
+    void* cqMap = nullptr;
+    H::inl_szt_ cqMapSize = 0;
+    ::io_uring_sqe* sqes = nullptr;
+    H::inl_szt_ sqesSize = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    ::io_uring_cqe* cqes = nullptr;
+    unsigned unsubmitted = 0;
+  };
+
+  template <typename T>
+  static T* at(void* base, unsigned offset) NOEXCEPT {
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+  }
+
+  bool setupRing(unsigned entries) NOEXCEPT {
+    ::io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    const long fd = ::syscall(SYS_io_uring_setup, entries, &params);
+    if(fd < 0)
+      return false;
+    ring_.fd = int(fd);
+    ring_.entries = params.sq_entries;
+
+    ring_.sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring_.cqMapSize = params.cq_off.cqes +
+      params.cq_entries * sizeof(::io_uring_cqe);
+    const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(single) {
+      if(ring_.cqMapSize > ring_.sqMapSize)
+        ring_.sqMapSize = ring_.cqMapSize;
+      ring_.cqMapSize = 0;
+    }
+    ring_.sqMap = ::mmap(nullptr, ring_.sqMapSize, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring_.fd, IORING_OFF_SQ_RING);
+    if(ring_.sqMap == MAP_FAILED) {
+      ring_.sqMap = nullptr;
+      this->teardownRing();
+      return false;
+    }
+    ring_.cqMap = ring_.sqMap;
+    if(!single) {
+      ring_.cqMap = ::mmap(nullptr, ring_.cqMapSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_.fd, IORING_OFF_CQ_RING);
+      if(ring_.cqMap == MAP_FAILED) {
+        ring_.cqMap = nullptr;
+        this->teardownRing();
+        return false;
+      }
+    }
+    ring_.sqesSize = params.sq_entries * sizeof(::io_uring_sqe);
+    void* const sqes = ::mmap(nullptr, ring_.sqesSize, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring_.fd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED) {
+      this->teardownRing();
+      return false;
+    }
+    ring_.sqes = static_cast<::io_uring_sqe*>(sqes);
+
+    ring_.sqHead = at<unsigned>(ring_.sqMap, params.sq_off.head);
+    ring_.sqTail = at<unsigned>(ring_.sqMap, params.sq_off.tail);
+    ring_.sqMask = at<unsigned>(ring_.sqMap, params.sq_off.ring_mask);
+    ring_.sqArray = at<unsigned>(ring_.sqMap, params.sq_off.array);
+    ring_.cqHead = at<unsigned>(ring_.cqMap, params.cq_off.head);
+    ring_.cqTail = at<unsigned>(ring_.cqMap, params.cq_off.tail);
+    ring_.cqMask = at<unsigned>(ring_.cqMap, params.cq_off.ring_mask);
+    ring_.cqes = at<::io_uring_cqe>(ring_.cqMap, params.cq_off.cqes);
+    backend_ = Backend::URING;
+    return true;
+  }
+
+  void teardownRing() NOEXCEPT {
+    if(ring_.sqes)
+      ::munmap(ring_.sqes, ring_.sqesSize);
+    if(ring_.cqMap && ring_.cqMap != ring_.sqMap)
+      ::munmap(ring_.cqMap, ring_.cqMapSize);
+    if(ring_.sqMap)
+      ::munmap(ring_.sqMap, ring_.sqMapSize);
+    if(ring_.fd >= 0)
+      ::close(ring_.fd);
+    ring_ = Ring();
+  }
+
+  int enterRing(unsigned submit, unsigned wait) NOEXCEPT {
+    const unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0u;
+    long ret;
+    do {
+      ret = ::syscall(SYS_io_uring_enter, ring_.fd,
+        submit, wait, flags, nullptr, 0);
+    } while(ret < 0 && errno == EINTR);
+    if(ret > 0)
+      ring_.unsubmitted -= unsigned(ret);
+    return int(ret);
+  }
+
+  void pushRing(Op* op) NOEXCEPT {
+    unsigned tail = *ring_.sqTail;
+    while(tail - __atomic_load_n(ring_.sqHead, __ATOMIC_ACQUIRE)
+      >= ring_.entries) {
+      // Full, flush what's queued to make room.
+      if(this->enterRing(ring_.unsubmitted, 0) < 0)
+        std::this_thread::yield();
+    }
+    const unsigned index = tail & *ring_.sqMask;
+    ::io_uring_sqe* const sqe = ring_.sqes + index;
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = op->fd_;
+    sqe->user_data = reinterpret_cast<std::uint64_t>(op);
+    switch(op->kind_) {
+     case Op::Kind::READ:
+     case Op::Kind::WRITE:
+      // The vectored forms work on every io_uring kernel (5.1+).
+      sqe->opcode = (op->kind_ == Op::Kind::READ) ?
+        IORING_OP_READV : IORING_OP_WRITEV;
+      sqe->addr = reinterpret_cast<std::uint64_t>(&op->vec_);
+      sqe->len = 1;
+      sqe->off = op->offset_;
+      break;
+     case Op::Kind::READ_FIXED:
+     case Op::Kind::WRITE_FIXED:
+      sqe->opcode = (op->kind_ == Op::Kind::READ_FIXED) ?
+        IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+      sqe->addr = reinterpret_cast<std::uint64_t>(op->vec_.iov_base);
+      sqe->len = unsigned(op->vec_.iov_len);
+      sqe->off = op->offset_;
+      sqe->buf_index = static_cast<decltype(sqe->buf_index)>(op->index_);
+      break;
+     case Op::Kind::FSYNC:
+      sqe->opcode = IORING_OP_FSYNC;
+      break;
+    }
+    ring_.sqArray[index] = index;
+    __atomic_store_n(ring_.sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++ring_.unsubmitted;
+  }
+
+  H::inl_szt_ pollRing(bool wait) {
+    const unsigned minWait = (wait && inFlight_ != 0) ? 1u : 0u;
+    if(ring_.unsubmitted != 0 || minWait != 0) {
+      // Skip the wait if completions are already there.
+      const bool ready = __atomic_load_n(ring_.cqTail, __ATOMIC_ACQUIRE)
+        != *ring_.cqHead;
+      (void) this->enterRing(ring_.unsubmitted, ready ? 0u : minWait);
+    }
+    H::inl_szt_ resumed = 0;
+    unsigned head = *ring_.cqHead;
+    while(head != __atomic_load_n(ring_.cqTail, __ATOMIC_ACQUIRE)) {
+      const ::io_uring_cqe& cqe = ring_.cqes[head & *ring_.cqMask];
+      Op* const op = reinterpret_cast<Op*>(cqe.user_data);
+      op->result_ = cqe.res;
+      __atomic_store_n(ring_.cqHead, ++head, __ATOMIC_RELEASE);
+      --inFlight_;
+      op->handle_.resume();
+      ++resumed;
+      head = *ring_.cqHead;
+    }
+    return resumed;
+  }
+#endif // EFLI_IO_URING_
+
+private:
+  Backend backend_ = Backend::THREADS;
+  H::inl_szt_ inFlight_ = 0;
+  H::inl_szt_ spawned_ = 0;
+#if defined(EFLI_IO_URING_)
+  Ring ring_;
+#endif
+  // Thread pool state.
+  std::vector<Op*> staged_;
+  std::mutex lock_;
+  std::condition_variable wake_;
+  std::vector<Op*> queue_;
+  std::vector<Op*> completed_;
+  std::atomic<std::uint32_t> epoch_ { 0 };
+  bool stop_ = false;
+  std::vector<std::thread> workers_;
+};
+
+inline void Op::await_suspend(std::coroutine_handle<> caller) {
+  handle_ = caller;
+  exec_->enqueue(this);
+}
+
+} // namespace io
+} // namespace config
+} // namespace efl
+
+#undef EFLI_IO_URING_
+
+#endif // EFL_HAS_COROUTINES
+
+#endif // EFL_IO_HPP
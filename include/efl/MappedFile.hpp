@@ -0,0 +1,411 @@
+//===- efl/MappedFile.hpp -------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides memory-mapped file views and checked spans.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_MAPPED_FILE_HPP
+#define EFL_MAPPED_FILE_HPP
+
+#include <efl/Config.hpp>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(PLATFORM_WINDOWS)
+# include <windows.h>
+#elif defined(PLATFORM_LINUX) || defined(PLATFORM_ANDROID) || \
+  defined(PLATFORM_APPLE) || defined(PLATFORM_HAIKU) || \
+  defined(PLATFORM_SOLARIS) || defined(PLATFORM_SUNOS)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+# define EFLI_MAPPED_FILE_POSIX_ 1
+#endif
+
+namespace efl {
+namespace config {
+
+/**
+ * A non-owning view of `count` objects. Only `subspan` and
+ * `at` check bounds, `operator[]` is unchecked.
+ */
+template <typename T>
+class Span {
+public:
+  using value_type = typename std::remove_cv<T>::type;
+  using size_type = H::inl_szt_;
+
+public:
+  constexpr Span() NOEXCEPT = default;
+  constexpr Span(T* data, size_type count) NOEXCEPT
+   : data_(data), count_(count) { }
+
+  constexpr T* data() const NOEXCEPT { return data_; }
+  constexpr size_type size() const NOEXCEPT { return count_; }
+  constexpr size_type sizeBytes() const NOEXCEPT
+  { return count_ * sizeof(T); }
+  constexpr bool isEmpty() const NOEXCEPT { return count_ == 0; }
+
+  constexpr T* begin() const NOEXCEPT { return data_; }
+  constexpr T* end() const NOEXCEPT { return data_ + count_; }
+
+  T& operator[](size_type index) const NOEXCEPT { return data_[index]; }
+
+  /// Pointer to element `index`, or `nullptr` if out of bounds.
+  T* at(size_type index) const NOEXCEPT
+  { return (index < count_) ? data_ + index : nullptr; }
+
+  /// Elements `[offset, offset + count)`, empty if out of bounds.
+  Span subspan(size_type offset, size_type count) const NOEXCEPT {
+    if(offset > count_ || count > count_ - offset)
+      return Span();
+    return Span(data_ + offset, count);
+  }
+
+private:
+  T* data_ = nullptr;
+  size_type count_ = 0;
+};
+
+/**
+ * A whole file mapped into memory, read-only or read-write.
+ * Opening failures leave it closed (see `isOpen`).
+ * Views are typed and checked against the mapped size,
+ * so headers and records can be read in place.
+ */
+class MappedFile {
+public:
+  enum class Mode {
+    READ_ONLY,
+    READ_WRITE,  ///< Writes go back to the file.
+  };
+
+  enum MapFlags : unsigned {
+    NONE       = 0,
+    POPULATE   = 1u << 0,  ///< Prefault every page when mapping.
+    HUGE_PAGES = 1u << 1,  ///< Align to `Arch::hugePageSize` and ask for THP.
+  };
+
+  enum class Advice {
+    NORMAL,
+    SEQUENTIAL,  ///< Aggressive readahead, drop pages behind.
+    RANDOM,      ///< No readahead.
+    WILL_NEED,   ///< Start reading in now.
+    DONT_NEED,   ///< Pages may be dropped, clean ones reread later.
+  };
+
+public:
+  MappedFile() = default;
+
+  /// See `open`.
+  explicit MappedFile(const char* path, Mode mode = Mode::READ_ONLY,
+   unsigned flags = NONE, H::inl_szt_ size = 0) NOEXCEPT
+  { this->open(path, mode, flags, size); }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) NOEXCEPT
+  { this->steal(other); }
+
+  MappedFile& operator=(MappedFile&& other) NOEXCEPT {
+    if(this != &other) {
+      this->close();
+      this->steal(other);
+    }
+    return *this;
+  }
+
+  ~MappedFile() { this->close(); }
+
+  /**
+   * Maps `path`, closing any previous file. In `READ_WRITE` mode
+   * the file is created if needed and grown to at least `size`.
+   * Returns false on failure.
+   */
+  bool open(const char* path, Mode mode = Mode::READ_ONLY,
+   unsigned flags = NONE, H::inl_szt_ size = 0) NOEXCEPT {
+    this->close();
+    const bool write = (mode == Mode::READ_WRITE);
+#if defined(EFLI_MAPPED_FILE_POSIX_)
+    const int fd = ::open(path, write ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+    if(fd < 0)
+      return false;
+    struct stat info;
+    if(::fstat(fd, &info) != 0) {
+      ::close(fd);
+      return false;
+    }
+    H::inl_szt_ length = H::inl_szt_(info.st_size);
+    if(write && size > length) {
+      if(::ftruncate(fd, off_t(size)) != 0) {
+        ::close(fd);
+        return false;
+      }
+      length = size;
+    }
+    if(length != 0 && !this->mapPosix(fd, length, write, flags)) {
+      ::close(fd);
+      return false;
+    }
+    // The mapping keeps the file alive on its own.
+    ::close(fd);
+#elif defined(PLATFORM_WINDOWS)
+    const HANDLE file = ::CreateFileA(path,
+      write ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+      FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+      write ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+      return false;
+    LARGE_INTEGER current;
+    if(!::GetFileSizeEx(file, &current)) {
+      ::CloseHandle(file);
+      return false;
+    }
+    H::inl_szt_ length = H::inl_szt_(current.QuadPart);
+    if(write && size > length)
+      length = size;
+    if(length != 0) {
+      // Mapping past the end grows the file.
+      const std::uint64_t wide = length;
+      const HANDLE mapping = ::CreateFileMappingW(file, nullptr,
+        write ? PAGE_READWRITE : PAGE_READONLY,
+        DWORD(wide >> 32), DWORD(wide & 0xFFFFFFFFu), nullptr);
+      if(!mapping) {
+        ::CloseHandle(file);
+        return false;
+      }
+      void* const base = ::MapViewOfFile(mapping,
+        write ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, length);
+      ::CloseHandle(mapping);
+      if(!base) {
+        ::CloseHandle(file);
+        return false;
+      }
+      data_ = static_cast<unsigned char*>(base);
+    }
+    ::CloseHandle(file);
+#else
+    (void) path;
+    (void) size;
+    (void) write;
+    return false;
+#endif
+    size_ = length;
+    writable_ = write;
+    open_ = true;
+    if((flags & POPULATE) && !this->hasPopulate())
+      (void) this->advise(Advice::WILL_NEED);
+    return true;
+  }
+
+  void close() NOEXCEPT {
+    if(data_) {
+#if defined(EFLI_MAPPED_FILE_POSIX_)
+      ::munmap(data_, size_);
+#elif defined(PLATFORM_WINDOWS)
+      ::UnmapViewOfFile(data_);
+#endif
+    }
+    data_ = nullptr;
+    size_ = 0;
+    writable_ = false;
+    open_ = false;
+  }
+
+  bool isOpen() const NOEXCEPT { return open_; }
+  bool isWritable() const NOEXCEPT { return writable_; }
+  H::inl_szt_ size() const NOEXCEPT { return size_; }
+  const unsigned char* data() const NOEXCEPT { return data_; }
+  unsigned char* mutableData() NOEXCEPT
+  { return writable_ ? data_ : nullptr; }
+
+  /**
+   * Applies `advice` to `[offset, offset + length)`, or to the rest
+   * of the file when `length` is 0. Returns false if unsupported.
+   */
+  bool advise(Advice advice, H::inl_szt_ offset = 0,
+   H::inl_szt_ length = 0) NOEXCEPT {
+    if(!data_ || offset >= size_)
+      return false;
+    if(length == 0 || length > size_ - offset)
+      length = size_ - offset;
+#if defined(EFLI_MAPPED_FILE_POSIX_)
+    // `madvise` wants a page aligned start.
+    const H::inl_szt_ page = H::inl_szt_(::sysconf(_SC_PAGESIZE));
+    const H::inl_szt_ start = offset - (offset % page);
+    int native = MADV_NORMAL;
+    switch(advice) {
+     case Advice::SEQUENTIAL: native = MADV_SEQUENTIAL; break;
+     case Advice::RANDOM:     native = MADV_RANDOM;     break;
+     case Advice::WILL_NEED:  native = MADV_WILLNEED;   break;
+     case Advice::DONT_NEED:  native = MADV_DONTNEED;   break;
+     default: break;
+    }
+    return ::madvise(data_ + start, length + (offset - start), native) == 0;
+#elif defined(PLATFORM_WINDOWS) && (_WIN32_WINNT >= 0x0602)
+    if(advice != Advice::WILL_NEED)
+      return false;
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = data_ + offset;
+    range.NumberOfBytes = length;
+    return ::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0) != 0;
+#else
+    (void) advice;
+    return false;
+#endif
+  }
+
+  /// Writes dirty pages back, waits for completion unless `async`.
+  bool flush(bool async = false) NOEXCEPT {
+    if(!data_ || !writable_)
+      return false;
+#if defined(EFLI_MAPPED_FILE_POSIX_)
+    return ::msync(data_, size_, async ? MS_ASYNC : MS_SYNC) == 0;
+#elif defined(PLATFORM_WINDOWS)
+    (void) async;
+    return ::FlushViewOfFile(data_, 0) != 0;
+#else
+    (void) async;
+    return false;
+#endif
+  }
+
+  /// All complete `T`s in the file.
+  template <typename T>
+  Span<const T> view() const NOEXCEPT {
+    return this->view<T>(0, size_ / sizeof(T));
+  }
+
+  /**
+   * `count` objects starting at byte `offset`, empty if they don't
+   * fit or `offset` isn't aligned for `T`.
+   */
+  template <typename T>
+  Span<const T> view(H::inl_szt_ offset, H::inl_szt_ count) const NOEXCEPT {
+    static_assert(std::is_trivially_copyable<T>::value,
+      "Mapped views require a trivially copyable `T`.");
+    if(!this->fits(offset, count, sizeof(T), alignof(T)))
+      return Span<const T>();
+    return Span<const T>(
+      reinterpret_cast<const T*>(data_ + offset), count);
+  }
+
+  /// Like `view`, but writable. Empty in `READ_ONLY` mode.
+  template <typename T>
+  Span<T> mutableView(H::inl_szt_ offset, H::inl_szt_ count) NOEXCEPT {
+    static_assert(std::is_trivially_copyable<T>::value,
+      "Mapped views require a trivially copyable `T`.");
+    if(!writable_ || !this->fits(offset, count, sizeof(T), alignof(T)))
+      return Span<T>();
+    return Span<T>(reinterpret_cast<T*>(data_ + offset), count);
+  }
+
+  /// The `T` at byte `offset`, or `nullptr` (see `view`).
+  template <typename T>
+  const T* at(H::inl_szt_ offset) const NOEXCEPT {
+    return this->view<T>(offset, 1).data();
+  }
+
+private:
+  void steal(MappedFile& other) NOEXCEPT {
+    data_ = other.data_;
+    size_ = other.size_;
+    writable_ = other.writable_;
+    open_ = other.open_;
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.writable_ = false;
+    other.open_ = false;
+  }
+
+  bool fits(H::inl_szt_ offset, H::inl_szt_ count,
+   H::inl_szt_ size, H::inl_szt_ align) const NOEXCEPT {
+    if(!data_ || offset > size_)
+      return false;
+    if(count > (size_ - offset) / size)
+      return false;
+    return (reinterpret_cast<std::uintptr_t>(data_ + offset) % align) == 0;
+  }
+
+  static constexpr bool hasPopulate() NOEXCEPT {
+#if defined(MAP_POPULATE)
+    return true;
+#else
+    return false;
+#endif
+  }
+
+#if defined(EFLI_MAPPED_FILE_POSIX_)
+  bool mapPosix(int fd, H::inl_szt_ length,
+   bool write, unsigned flags) NOEXCEPT {
+    const int prot = write ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    int extra = 0;
+# if defined(MAP_POPULATE)
+    if(flags & POPULATE)
+      extra |= MAP_POPULATE;
+# endif
+    const H::inl_szt_ huge = H::inl_szt_(Arch::hugePageSize);
+    if((flags & HUGE_PAGES) && huge != 0 && length >= huge) {
+      // Reserve a larger range, then map at an aligned address inside.
+      void* const reserved = ::mmap(nullptr, length + huge, PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if(reserved != MAP_FAILED) {
+        const auto raw = reinterpret_cast<std::uintptr_t>(reserved);
+        const std::uintptr_t aligned = (raw + huge - 1) & ~(huge - 1);
+        void* const base = ::mmap(reinterpret_cast<void*>(aligned), length,
+          prot, MAP_SHARED | MAP_FIXED | extra, fd, 0);
+        if(aligned != raw)
+          ::munmap(reserved, aligned - raw);
+        const std::uintptr_t tail = aligned + length;
+        const std::uintptr_t end = raw + length + huge;
+        if(end > tail)
+          ::munmap(reinterpret_cast<void*>(tail), end - tail);
+        if(base != MAP_FAILED) {
+# if defined(MADV_HUGEPAGE)
+          (void) ::madvise(base, length, MADV_HUGEPAGE);
+# endif
+          data_ = static_cast<unsigned char*>(base);
+          return true;
+        }
+        ::munmap(reinterpret_cast<void*>(aligned), length);
+      }
+    }
+    void* const base = ::mmap(nullptr, length, prot, MAP_SHARED | extra, fd, 0);
+    if(base == MAP_FAILED)
+      return false;
+    data_ = static_cast<unsigned char*>(base);
+    return true;
+  }
+#endif // EFLI_MAPPED_FILE_POSIX_
+
+private:
+  unsigned char* data_ = nullptr;
+  H::inl_szt_ size_ = 0;
+  bool writable_ = false;
+  bool open_ = false;
+};
+
+} // namespace config
+} // namespace efl
+
+#undef EFLI_MAPPED_FILE_POSIX_
+
+#endif // EFL_MAPPED_FILE_HPP
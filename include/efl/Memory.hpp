@@ -0,0 +1,210 @@
+//===- efl/Memory.hpp -----------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides low level memory utilities built on `Config.hpp`.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_MEMORY_HPP
+#define EFL_MEMORY_HPP
+
+#include <efl/Config.hpp>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+#if defined(PLATFORM_WINDOWS)
+# include <malloc.h>
+# define EFLI_ALIGNED_ALLOC_WIN_ 1
+#elif defined(PLATFORM_LINUX) || defined(PLATFORM_ANDROID) || \
+  defined(PLATFORM_APPLE) || defined(PLATFORM_HAIKU) || \
+  defined(PLATFORM_SOLARIS) || defined(PLATFORM_SUNOS)
+# define EFLI_ALIGNED_ALLOC_POSIX_ 1
+#elif CPPVER_LEAST(17)
+# define EFLI_ALIGNED_ALLOC_STD_ 1
+#endif
+
+#ifndef EFL_HAS_BUILTIN_BIT_CAST
+/// If `bitCast` is `constexpr`, which needs `__builtin_bit_cast`.
+# if EFL_HAS_BUILTIN(__builtin_bit_cast) || \
+  (defined(COMPILER_MSVC) && (_MSC_VER >= 1927))
+#  define EFL_HAS_BUILTIN_BIT_CAST 1
+# else
+#  define EFL_HAS_BUILTIN_BIT_CAST 0
+# endif
+#endif
+
+namespace efl {
+namespace config {
+namespace H {
+  ALWAYS_INLINE constexpr bool isPow2(inl_szt_ n) NOEXCEPT
+  { return (n != 0) && ((n & (n - 1)) == 0); }
+
+  ALWAYS_INLINE constexpr inl_szt_ alignUp(inl_szt_ n, inl_szt_ align) NOEXCEPT
+  { return (n + (align - 1)) & ~(align - 1); }
+} // namespace H
+
+/**
+ * Allocates `size` bytes aligned to `align`, which must be a power of two.
+ * Returns `nullptr` on failure, the result must be freed with `alignedFree`.
+ */
+COMPILER_UNALIASED EFL_ALLOC_ALIGN(1) EFL_ALLOC_SIZE(2) NODISCARD
+inline void* alignedAlloc(std::size_t align, std::size_t size) NOEXCEPT {
+  if(!H::isPow2(align))
+    return nullptr;
+  if(align < sizeof(void*))
+    align = sizeof(void*);
+#if defined(EFLI_ALIGNED_ALLOC_WIN_)
+  return ::_aligned_malloc(size, align);
+#elif defined(EFLI_ALIGNED_ALLOC_POSIX_)
+  void* ptr = nullptr;
+  if(::posix_memalign(&ptr, align, size) != 0)
+    return nullptr;
+  return ptr;
+#elif defined(EFLI_ALIGNED_ALLOC_STD_)
+  // `aligned_alloc` requires the size to be a multiple of the alignment.
+  return std::aligned_alloc(align, H::alignUp(size ? size : 1, align));
+#else
+  // Stores the base pointer directly before the aligned block.
+  const std::size_t total = size + align + sizeof(void*);
+  void* const base = std::malloc(total);
+  if(!base)
+    return nullptr;
+  const auto addr = reinterpret_cast<std::size_t>(base) + sizeof(void*);
+  void* const ptr = reinterpret_cast<void*>(H::alignUp(addr, align));
+  static_cast<void**>(ptr)[-1] = base;
+  return ptr;
+#endif
+}
+
+/// Frees memory returned by `alignedAlloc` or `alignedRealloc`.
+inline void alignedFree(void* ptr) NOEXCEPT {
+#if defined(EFLI_ALIGNED_ALLOC_WIN_)
+  ::_aligned_free(ptr);
+#elif defined(EFLI_ALIGNED_ALLOC_POSIX_) || defined(EFLI_ALIGNED_ALLOC_STD_)
+  std::free(ptr);
+#else
+  if(ptr)
+    std::free(static_cast<void**>(ptr)[-1]);
+#endif
+}
+
+/**
+ * Resizes a block returned by `alignedAlloc`, preserving its alignment.
+ * `oldSize` must be the size the block was last allocated with.
+ * On failure `nullptr` is returned and `ptr` is left untouched.
+ * A `newSize` of 0 still allocates (as 1 byte), so `ptr` is only
+ * ever freed when a non-null block replaces it.
+ * Not marked `COMPILER_UNALIASED`, the result may hold pointers to live objects.
+ */
+EFL_ALLOC_ALIGN(2) EFL_ALLOC_SIZE(4) NODISCARD
+inline void* alignedRealloc(void* ptr, std::size_t align,
+ std::size_t oldSize, std::size_t newSize) NOEXCEPT {
+  // `_aligned_realloc` frees on 0, and `posix_memalign` may return null.
+  if(newSize == 0)
+    newSize = 1;
+  if(!ptr)
+    return alignedAlloc(align, newSize);
+#if defined(EFLI_ALIGNED_ALLOC_WIN_)
+  (void)oldSize;
+  if(!H::isPow2(align))
+    return nullptr;
+  // Leaves `ptr` intact when it fails, as long as `newSize` isn't 0.
+  return ::_aligned_realloc(ptr, newSize,
+    (align < sizeof(void*)) ? sizeof(void*) : align);
+#else
+  void* const out = alignedAlloc(align, newSize);
+  if(!out)
+    return nullptr;
+  std::memcpy(out, ptr, (oldSize < newSize) ? oldSize : newSize);
+  alignedFree(ptr);
+  return out;
+#endif
+}
+
+/**
+ * Copies exactly `N` bytes, the ranges must not overlap.
+ * With `__builtin_memcpy_inline` (Clang) the copy is always expanded
+ * inline, even in `-fno-builtin` TUs. Elsewhere `__builtin_memcpy`
+ * is usually inlined for small `N`, but may still become a libc call.
+ */
+template <H::inl_szt_ N>
+ALWAYS_INLINE void copyN(void* RESTRICT dst,
+ const void* RESTRICT src) NOEXCEPT {
+#if EFL_HAS_BUILTIN(__builtin_memcpy_inline)
+  __builtin_memcpy_inline(dst, src, N);
+#elif defined(__GNUC__)
+  __builtin_memcpy(dst, src, N);
+#else
+  std::memcpy(dst, src, N);
+#endif
+}
+
+/**
+ * Sets exactly `N` bytes to `value`. Only guaranteed inline with
+ * `__builtin_memset_inline` (Clang), see `copyN`.
+ */
+template <H::inl_szt_ N>
+ALWAYS_INLINE void fillN(void* dst, unsigned char value) NOEXCEPT {
+#if EFL_HAS_BUILTIN(__builtin_memset_inline)
+  __builtin_memset_inline(dst, value, N);
+#elif defined(__GNUC__)
+  __builtin_memset(dst, value, N);
+#else
+  std::memset(dst, value, N);
+#endif
+}
+
+/**
+ * Reinterprets the bytes of `from` as a `To`, like C++20 `std::bit_cast`.
+ * `constexpr` when `EFL_HAS_BUILTIN_BIT_CAST`, even before C++20.
+ */
+template <typename To, typename From>
+#if EFL_HAS_BUILTIN_BIT_CAST
+ALWAYS_INLINE constexpr To bitCast(const From& from) NOEXCEPT {
+  static_assert(sizeof(To) == sizeof(From),
+    "`To` and `From` must be the same size.");
+  static_assert(std::is_trivially_copyable<To>::value &&
+    std::is_trivially_copyable<From>::value,
+    "`To` and `From` must be trivially copyable.");
+  return __builtin_bit_cast(To, from);
+}
+#else
+ALWAYS_INLINE To bitCast(const From& from) NOEXCEPT {
+  static_assert(sizeof(To) == sizeof(From),
+    "`To` and `From` must be the same size.");
+  static_assert(std::is_trivially_copyable<To>::value &&
+    std::is_trivially_copyable<From>::value,
+    "`To` and `From` must be trivially copyable.");
+  static_assert(std::is_trivially_default_constructible<To>::value,
+    "`To` must be default constructible without `__builtin_bit_cast`.");
+  To out;
+  copyN<sizeof(To)>(&out, &from);
+  return out;
+}
+#endif
+
+} // namespace config
+} // namespace efl
+
+#undef EFLI_ALIGNED_ALLOC_WIN_
+#undef EFLI_ALIGNED_ALLOC_POSIX_
+#undef EFLI_ALIGNED_ALLOC_STD_
+
+#endif // EFL_MEMORY_HPP
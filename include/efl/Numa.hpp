@@ -0,0 +1,264 @@
+//===- efl/Numa.hpp -------------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides NUMA node queries, placement and allocation.
+//  Uses raw syscalls on Linux, so no libnuma is needed.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_NUMA_HPP
+#define EFL_NUMA_HPP
+
+#include <efl/Memory.hpp>
+#include <efl/Topology.hpp>
+
+#if defined(PLATFORM_WINDOWS)
+# include <windows.h>
+#elif defined(PLATFORM_LINUX) || defined(PLATFORM_ANDROID)
+# include <sched.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+# define EFLI_NUMA_LINUX_ 1
+# define EFLI_NUMA_MMAP_ 1
+#elif defined(PLATFORM_APPLE) || defined(PLATFORM_HAIKU) || \
+  defined(PLATFORM_SOLARIS) || defined(PLATFORM_SUNOS)
+# include <sys/mman.h>
+# define EFLI_NUMA_MMAP_ 1
+#endif
+
+namespace efl {
+namespace config {
+namespace H {
+#if defined(EFLI_NUMA_LINUX_)
+  // From <linux/mempolicy.h>, which isn't always installed.
+  constexpr int mpolDefault = 0;
+  constexpr int mpolBind = 2;
+  constexpr int mpolInterleave = 3;
+
+  /// Node bitmask in the layout `mbind` and `set_mempolicy` expect.
+  struct NodeMask {
+    static constexpr unsigned wordBits = sizeof(unsigned long) * 8;
+    static constexpr unsigned maxWords = 16;
+    unsigned long words[maxWords] = {};
+
+    void set(unsigned node) NOEXCEPT {
+      if(node < maxWords * wordBits)
+        words[node / wordBits] |= (1ul << (node % wordBits));
+    }
+    /// The kernel drops the last bit, so pass one more than the size.
+    unsigned long maxNode() const NOEXCEPT
+    { return maxWords * wordBits + 1; }
+  };
+
+  inline long setPolicy(int mode, const NodeMask* mask) NOEXCEPT {
+    return ::syscall(SYS_set_mempolicy, mode,
+      mask ? mask->words : nullptr, mask ? mask->maxNode() : 0ul);
+  }
+
+  inline long bindRegion(void* base, inl_szt_ size,
+   int mode, const NodeMask& mask) NOEXCEPT {
+    return ::syscall(SYS_mbind, base, size, mode,
+      mask.words, mask.maxNode(), 0u);
+  }
+#endif // EFLI_NUMA_LINUX_
+
+  inline void* mapNodeRegion(inl_szt_ size) NOEXCEPT {
+#if defined(EFLI_NUMA_MMAP_)
+    void* const base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (base == MAP_FAILED) ? nullptr : base;
+#elif defined(PLATFORM_WINDOWS)
+    return ::VirtualAlloc(nullptr, size,
+      MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    return alignedAlloc(Arch::pageSize, size);
+#endif
+  }
+} // namespace H
+
+namespace numa {
+
+// Queries default to the host, pass `Topology::fromSysfs(root)`
+// to run them against a fake sysfs tree instead.
+
+/// The number of NUMA nodes, 1 when unknown.
+inline unsigned nodeCount(const Topology& topology = Topology::query()) {
+  const unsigned count = topology.nodeCount();
+  return count ? count : 1;
+}
+
+/// Checks if there is more than one node to care about.
+inline bool isNuma(const Topology& topology = Topology::query()) {
+  return nodeCount(topology) > 1;
+}
+
+/// The node the calling thread is running on, may be stale.
+inline unsigned currentNode() NOEXCEPT {
+#if defined(EFLI_NUMA_LINUX_)
+  unsigned cpu = 0, node = 0;
+  if(::syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+    return node;
+#elif defined(PLATFORM_WINDOWS)
+  PROCESSOR_NUMBER number;
+  USHORT node = 0;
+  ::GetCurrentProcessorNumberEx(&number);
+  if(::GetNumaProcessorNodeEx(&number, &node))
+    return node;
+#endif
+  return 0;
+}
+
+/**
+ * Allocates `size` bytes of page-aligned memory placed on `node`.
+ * Placement is best-effort, on single-node hosts this is a plain
+ * mapping. Returns `nullptr` on failure, free with `deallocate`.
+ */
+NODISCARD inline void* allocOnNode(H::inl_szt_ size, unsigned node,
+ const Topology& topology = Topology::query()) {
+  if(size == 0)
+    return nullptr;
+#if defined(PLATFORM_WINDOWS)
+  if(isNuma(topology)) {
+    void* const base = ::VirtualAllocExNuma(::GetCurrentProcess(),
+      nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, DWORD(node));
+    if(base)
+      return base;
+  }
+  return H::mapNodeRegion(size);
+#else
+  void* const base = H::mapNodeRegion(size);
+# if defined(EFLI_NUMA_LINUX_)
+  if(base && isNuma(topology)) {
+    H::NodeMask mask;
+    mask.set(node);
+    // Pages are only placed on first touch, so a failure here is harmless.
+    (void) H::bindRegion(base, size, H::mpolBind, mask);
+  }
+# else
+  (void) node;
+  (void) topology;
+# endif
+  return base;
+#endif
+}
+
+/**
+ * Allocates `size` bytes with pages spread round-robin over all nodes.
+ * Useful for large shared tables. Free with `deallocate`.
+ */
+NODISCARD inline void* allocInterleaved(H::inl_szt_ size,
+ const Topology& topology = Topology::query()) {
+  if(size == 0)
+    return nullptr;
+  void* const base = H::mapNodeRegion(size);
+#if defined(EFLI_NUMA_LINUX_)
+  if(base && isNuma(topology)) {
+    H::NodeMask mask;
+    for(const CpuInfo& cpu : topology.cpus())
+      mask.set(cpu.node);
+    (void) H::bindRegion(base, size, H::mpolInterleave, mask);
+  }
+#else
+  (void) topology;
+#endif
+  return base;
+}
+
+/// Frees memory from `allocOnNode` or `allocInterleaved`.
+inline void deallocate(void* base, H::inl_szt_ size) NOEXCEPT {
+  if(!base)
+    return;
+#if defined(EFLI_NUMA_MMAP_)
+  ::munmap(base, size);
+#elif defined(PLATFORM_WINDOWS)
+  (void) size;
+  ::VirtualFree(base, 0, MEM_RELEASE);
+#else
+  (void) size;
+  alignedFree(base);
+#endif
+}
+
+/**
+ * Makes the calling thread's future allocations interleave over
+ * all nodes, until `resetMemoryPolicy`. A no-op on single-node hosts.
+ */
+inline bool interleaveCurrentThread(
+ const Topology& topology = Topology::query()) {
+#if defined(EFLI_NUMA_LINUX_)
+  if(!isNuma(topology))
+    return true;
+  H::NodeMask mask;
+  for(const CpuInfo& cpu : topology.cpus())
+    mask.set(cpu.node);
+  return H::setPolicy(H::mpolInterleave, &mask) == 0;
+#else
+  (void) topology;
+  return true;
+#endif
+}
+
+/// Restores the default (local) allocation policy of the calling thread.
+inline bool resetMemoryPolicy() NOEXCEPT {
+#if defined(EFLI_NUMA_LINUX_)
+  return H::setPolicy(H::mpolDefault, nullptr) == 0;
+#else
+  return true;
+#endif
+}
+
+/**
+ * Restricts the calling thread to the CPUs of `node`.
+ * A no-op on single-node hosts, returns false on failure.
+ */
+inline bool pinThreadToNode(unsigned node,
+ const Topology& topology = Topology::query()) {
+  if(!isNuma(topology))
+    return true;
+#if defined(EFLI_NUMA_LINUX_)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  bool any = false;
+  for(const CpuInfo& cpu : topology.cpus()) {
+    if(cpu.node == node && cpu.id < CPU_SETSIZE) {
+      CPU_SET(cpu.id, &set);
+      any = true;
+    }
+  }
+  return any && ::sched_setaffinity(0, sizeof(set), &set) == 0;
+#elif defined(PLATFORM_WINDOWS)
+  GROUP_AFFINITY affinity = {};
+  if(!::GetNumaNodeProcessorMaskEx(USHORT(node), &affinity))
+    return false;
+  return ::SetThreadGroupAffinity(
+    ::GetCurrentThread(), &affinity, nullptr) != 0;
+#else
+  (void) node;
+  return true;
+#endif
+}
+
+} // namespace numa
+} // namespace config
+} // namespace efl
+
+#undef EFLI_NUMA_LINUX_
+#undef EFLI_NUMA_MMAP_
+
+#endif // EFL_NUMA_HPP
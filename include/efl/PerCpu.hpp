@@ -0,0 +1,177 @@
+//===- efl/PerCpu.hpp -----------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides data sharded by the current CPU.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_PER_CPU_HPP
+#define EFL_PER_CPU_HPP
+
+#include <efl/Memory.hpp>
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <thread>
+
+#if defined(PLATFORM_LINUX)
+# include <sched.h>
+# include <unistd.h>
+# if __has_include(<sys/rseq.h>) && EFL_HAS_BUILTIN(__builtin_thread_pointer)
+#  include <sys/rseq.h>
+#  if defined(RSEQ_SIG)
+#   define EFLI_PER_CPU_RSEQ_ 1
+#  endif
+# endif
+#endif
+
+namespace efl {
+namespace config {
+namespace H {
+  enum class CpuSource {
+    RSEQ,         ///< The kernel-updated `rseq` area, a single load.
+    GETCPU,       ///< `sched_getcpu`, usually through the vDSO.
+    THREAD_HASH,  ///< No CPU id, spreads threads by hash instead.
+  };
+
+  /// Picks the cheapest working way to find the current CPU, at runtime.
+  inline CpuSource cpuSource() NOEXCEPT {
+    static const CpuSource source = []() -> CpuSource {
+#if defined(EFLI_PER_CPU_RSEQ_)
+      // glibc 2.35+ registers rseq, and sets the size to 0 if it couldn't.
+      if(__rseq_size != 0)
+        return CpuSource::RSEQ;
+#endif
+#if defined(PLATFORM_LINUX)
+      if(::sched_getcpu() >= 0)
+        return CpuSource::GETCPU;
+#endif
+      return CpuSource::THREAD_HASH;
+    }();
+    return source;
+  }
+
+  inline unsigned threadHash() NOEXCEPT {
+    static THREAD_LOCAL char anchor;
+    const auto addr = reinterpret_cast<std::uintptr_t>(&anchor);
+    return static_cast<unsigned>(
+      (std::uint64_t(addr) * 0x9E3779B97F4A7C15ull) >> 40);
+  }
+
+  /// The CPU the caller is running on, may be stale by the time it's used.
+  ALWAYS_INLINE unsigned currentCpu() NOEXCEPT {
+    switch(cpuSource()) {
+#if defined(EFLI_PER_CPU_RSEQ_)
+     case CpuSource::RSEQ: {
+      const auto* area = reinterpret_cast<const volatile struct rseq*>(
+        static_cast<const char*>(__builtin_thread_pointer()) + __rseq_offset);
+      return area->cpu_id;
+     }
+#endif
+#if defined(PLATFORM_LINUX)
+     case CpuSource::GETCPU:
+      return static_cast<unsigned>(::sched_getcpu());
+#endif
+     default:
+      return threadHash();
+    }
+  }
+
+  inline inl_szt_ configuredCpus() NOEXCEPT {
+#if defined(PLATFORM_LINUX)
+    const long count = ::sysconf(_SC_NPROCESSORS_CONF);
+    if(count > 0)
+      return inl_szt_(count);
+#endif
+    const unsigned threads = std::thread::hardware_concurrency();
+    return threads ? threads : 1;
+  }
+} // namespace H
+
+/**
+ * A counter split into cache-line-padded cells indexed by CPU,
+ * so concurrent increments rarely share a line. Reads are lazy,
+ * `sum()` walks every cell.
+ */
+class PerCpuCounter {
+  struct alignas(Arch::destructiveInterference) Cell {
+    std::atomic<std::uint64_t> value { 0 };
+  };
+
+public:
+  /// Uses one cell per configured CPU when `cells` is 0.
+  explicit PerCpuCounter(H::inl_szt_ cells = 0) NOEXCEPT {
+    H::inl_szt_ count = 1;
+    const H::inl_szt_ want = cells ? cells : H::configuredCpus();
+    while(count < want)
+      count <<= 1;
+    void* const raw = alignedAlloc(alignof(Cell), sizeof(Cell) * count);
+    if(raw) {
+      cells_ = static_cast<Cell*>(raw);
+      mask_ = count - 1;
+    } else {
+      cells_ = &fallback_;
+      mask_ = 0;
+    }
+    for(H::inl_szt_ i = 0; i <= mask_; ++i)
+      ::new(cells_ + i) Cell();
+  }
+
+  PerCpuCounter(const PerCpuCounter&) = delete;
+  PerCpuCounter& operator=(const PerCpuCounter&) = delete;
+
+  ~PerCpuCounter() {
+    if(cells_ != &fallback_)
+      alignedFree(cells_);
+  }
+
+  ALWAYS_INLINE void add(std::uint64_t n = 1) NOEXCEPT {
+    // Still atomic, the thread may migrate after reading the CPU.
+    cells_[H::currentCpu() & mask_].value.fetch_add(
+      n, std::memory_order_relaxed);
+  }
+
+  ALWAYS_INLINE void increment() NOEXCEPT { this->add(1); }
+
+  /// Not a snapshot, concurrent adds may or may not be counted.
+  std::uint64_t sum() const NOEXCEPT {
+    std::uint64_t total = 0;
+    for(H::inl_szt_ i = 0; i <= mask_; ++i)
+      total += cells_[i].value.load(std::memory_order_relaxed);
+    return total;
+  }
+
+  void reset() NOEXCEPT {
+    for(H::inl_szt_ i = 0; i <= mask_; ++i)
+      cells_[i].value.store(0, std::memory_order_relaxed);
+  }
+
+  H::inl_szt_ cellCount() const NOEXCEPT { return mask_ + 1; }
+
+private:
+  Cell* cells_;
+  H::inl_szt_ mask_;
+  Cell fallback_;
+};
+
+} // namespace config
+} // namespace efl
+
+#undef EFLI_PER_CPU_RSEQ_
+
+#endif // EFL_PER_CPU_HPP
@@ -0,0 +1,549 @@
+//===- efl/Scheduler.hpp --------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides a topology-aware work-stealing scheduler.
+//  Jobs must not throw, exceptions escaping a job terminate.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_SCHEDULER_HPP
+#define EFL_SCHEDULER_HPP
+
+#include <efl/Sync.hpp>
+#include <efl/Thread.hpp>
+#include <efl/Topology.hpp>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace efl {
+namespace config {
+namespace H {
+  /// A type-erased unit of work, owns itself once submitted.
+  struct Job {
+    explicit Job(void(*call)(Job*)) NOEXCEPT : invoke(call) { }
+    void(*invoke)(Job*);
+  };
+
+  template <typename F>
+  struct FnJob : Job {
+    template <typename U>
+    explicit FnJob(U&& callable)
+     : Job(&FnJob::run), fn(std::forward<U>(callable)) { }
+    static void run(Job* job) {
+      auto* const self = static_cast<FnJob*>(job);
+      self->fn();
+      delete self;
+    }
+    F fn;
+  };
+
+  /**
+   * A Chase-Lev deque, as formulated for weak memory models
+   * by Le et al. The owner pushes and pops at the bottom,
+   * thieves take from the top. Grows on demand, old rings
+   * are kept until destruction so thieves never read freed memory.
+   */
+  class WorkDeque {
+    using Index = std::int64_t;
+
+    struct Ring {
+      explicit Ring(Index capacity)
+       : mask(capacity - 1), slots(new std::atomic<Job*>[capacity]) { }
+      Index capacity() const NOEXCEPT { return mask + 1; }
+      Job* get(Index i) const NOEXCEPT
+      { return slots[i & mask].load(std::memory_order_relaxed); }
+      void put(Index i, Job* job) NOEXCEPT
+      { slots[i & mask].store(job, std::memory_order_relaxed); }
+
+      Index mask;
+      std::unique_ptr<std::atomic<Job*>[]> slots;
+    };
+
+  public:
+    explicit WorkDeque(Index capacity = 256) {
+      rings_.emplace_back(new Ring(capacity));
+      ring_.store(rings_.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkDeque(const WorkDeque&) = delete;
+    WorkDeque& operator=(const WorkDeque&) = delete;
+
+    /// Owner only.
+    void push(Job* job) {
+      const Index bottom = bottom_.load(std::memory_order_relaxed);
+      const Index top = top_.load(std::memory_order_acquire);
+      Ring* ring = ring_.load(std::memory_order_relaxed);
+      if(bottom - top > ring->mask)
+        ring = this->grow(ring, top, bottom);
+      ring->put(bottom, job);
+      std::atomic_thread_fence(std::memory_order_release);
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    /// Owner only, returns `nullptr` when empty.
+    Job* pop() NOEXCEPT {
+      const Index bottom = bottom_.load(std::memory_order_relaxed) - 1;
+      Ring* const ring = ring_.load(std::memory_order_relaxed);
+      bottom_.store(bottom, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      Index top = top_.load(std::memory_order_relaxed);
+      if(top > bottom) {
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+      }
+      Job* job = ring->get(bottom);
+      if(top == bottom) {
+        // Last item, race the thieves for it.
+        if(!top_.compare_exchange_strong(top, top + 1,
+          std::memory_order_seq_cst, std::memory_order_relaxed))
+          job = nullptr;
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+      }
+      return job;
+    }
+
+    /// Any thread, returns `nullptr` when empty or on a lost race.
+    Job* steal() NOEXCEPT {
+      Index top = top_.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      const Index bottom = bottom_.load(std::memory_order_acquire);
+      if(top >= bottom)
+        return nullptr;
+      Job* const job = ring_.load(std::memory_order_acquire)->get(top);
+      if(!top_.compare_exchange_strong(top, top + 1,
+        std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+      return job;
+    }
+
+    /// Approximate while others are active.
+    Index size() const NOEXCEPT {
+      const Index bottom = bottom_.load(std::memory_order_relaxed);
+      const Index top = top_.load(std::memory_order_relaxed);
+      return (bottom > top) ? bottom - top : 0;
+    }
+
+  private:
+    Ring* grow(Ring* old, Index top, Index bottom) {
+      rings_.emplace_back(new Ring(old->capacity() * 2));
+      Ring* const ring = rings_.back().get();
+      for(Index i = top; i < bottom; ++i)
+        ring->put(i, old->get(i));
+      ring_.store(ring, std::memory_order_release);
+      return ring;
+    }
+
+  private:
+    alignas(Arch::destructiveInterference) std::atomic<Index> top_ { 0 };
+    alignas(Arch::destructiveInterference) std::atomic<Index> bottom_ { 0 };
+    std::atomic<Ring*> ring_;
+    std::vector<std::unique_ptr<Ring>> rings_;
+  };
+} // namespace H
+
+/**
+ * A fixed pool of workers with one `WorkDeque` each.
+ * Workers steal from victims sharing their last-level cache first,
+ * then their NUMA node, then anyone. Idle workers spin briefly
+ * and then park on a futex until new work is submitted.
+ */
+class Scheduler {
+  struct alignas(Arch::destructiveInterference) Worker {
+    H::WorkDeque deque;
+    std::thread thread;
+    int cpu = -1;
+    std::uint32_t seed = 0;
+    /// Other workers, nearest first, split into tiers by `tierEnds`.
+    std::vector<unsigned> victims;
+    std::vector<unsigned> tierEnds;
+  };
+
+  struct Current {
+    Scheduler* owner;
+    unsigned index;
+  };
+
+public:
+  /**
+   * Starts `workers` threads, or one per usable CPU when 0.
+   * Usable CPUs are those of `topology` in the calling thread's
+   * affinity mask (see `thread::getAffinity`).
+   * With `pin`, worker `i` is bound to the `i`th usable CPU.
+   */
+  explicit Scheduler(unsigned workers = 0, bool pin = true,
+   const Topology& topology = Topology::query()) {
+    std::vector<unsigned> usable;
+    thread::CpuSet allowed;
+    const bool masked = thread::getAffinity(allowed);
+    for(const CpuInfo& cpu : topology.cpus()) {
+      if(!masked || (cpu.id < allowed.size() && allowed[cpu.id]))
+        usable.push_back(cpu.id);
+    }
+    if(usable.empty() && masked) {
+      // Ids don't match the topology, size by the mask and don't pin.
+      count_ = unsigned(allowed.count());
+      pin = false;
+    } else
+      count_ = unsigned(usable.size());
+    if(workers)
+      count_ = workers;
+    if(count_ == 0)
+      count_ = 1;
+    void* const raw = alignedAlloc(alignof(Worker), sizeof(Worker) * count_);
+    if(!raw)
+      throw std::bad_alloc();
+    workers_ = static_cast<Worker*>(raw);
+    // On failure, stops whatever already started and rethrows.
+    unsigned built = 0, started = 0;
+    try {
+      for(; built < count_; ++built) {
+        Worker* const worker = ::new(workers_ + built) Worker();
+        worker->seed = 0x9E3779B9u * (built + 1);
+        if(pin && !usable.empty())
+          worker->cpu = int(usable[built % usable.size()]);
+      }
+      this->planVictims(topology);
+      for(; started < count_; ++started) {
+        workers_[started].thread =
+          std::thread(&Scheduler::workerMain, this, started);
+      }
+    } catch(...) {
+      this->shutdown(started, built);
+      throw;
+    }
+  }
+
+  Scheduler(const Scheduler&) = delete;
+  Scheduler& operator=(const Scheduler&) = delete;
+
+  /// Runs the remaining jobs and joins the workers.
+  ~Scheduler() {
+    this->shutdown(count_, count_);
+  }
+
+  /// A process-wide scheduler with the default configuration.
+  static Scheduler& shared() {
+    static Scheduler scheduler;
+    return scheduler;
+  }
+
+  /// Queues `fn` to run on some worker.
+  template <typename F>
+  void submit(F&& fn) {
+    using Fn = typename std::decay<F>::type;
+    this->enqueue(new H::FnJob<Fn>(std::forward<F>(fn)));
+  }
+
+  /**
+   * Calls `fn(i)` for every `i` in `[begin, end)` and waits.
+   * Ranges are split lazily, only while the local deque runs dry,
+   * so the effective grain adapts to how many workers are hungry.
+   * `grain` is the smallest range split off, 0 picks one.
+   */
+  template <typename F>
+  void parallelFor(H::inl_szt_ begin, H::inl_szt_ end,
+   F&& fn, H::inl_szt_ grain = 0) {
+    if(begin >= end)
+      return;
+    if(grain == 0) {
+      grain = (end - begin) / (H::inl_szt_(count_) * 8);
+      grain = grain ? grain : 1;
+    }
+    using Fn = typename std::remove_reference<F>::type;
+    std::atomic<std::uint32_t> pending { 1 };
+    RangeJob<Fn>* const root =
+      new RangeJob<Fn>(this, &fn, &pending, begin, end, grain);
+    if(this->isWorker()) {
+      RangeJob<Fn>::run(root);
+      this->helpUntil(pending);
+    } else {
+      this->enqueue(root);
+      std::uint32_t left;
+      while((left = pending.load(std::memory_order_acquire)) != 0)
+        atomicWait(&pending, left);
+    }
+  }
+
+  unsigned workerCount() const NOEXCEPT { return count_; }
+
+  /// The calling worker's index, or -1 outside this scheduler.
+  int currentWorker() const NOEXCEPT {
+    const Current& current = Scheduler::current();
+    return (current.owner == this) ? int(current.index) : -1;
+  }
+
+private:
+  /**
+   * Joins the first `started` workers, then destroys the first `built`.
+   * Every thread must be joined first, running ones steal from the rest.
+   */
+  void shutdown(unsigned started, unsigned built) NOEXCEPT {
+    stop_.store(true, std::memory_order_seq_cst);
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+    atomicNotifyAll(&epoch_);
+    for(unsigned i = 0; i < started; ++i)
+      workers_[i].thread.join();
+    for(unsigned i = 0; i < built; ++i)
+      workers_[i].~Worker();
+    alignedFree(workers_);
+  }
+
+  template <typename Fn>
+  struct RangeJob : H::Job {
+    RangeJob(Scheduler* sched, Fn* body, std::atomic<std::uint32_t>* counter,
+     H::inl_szt_ lo, H::inl_szt_ hi, H::inl_szt_ minSize) NOEXCEPT
+     : Job(&RangeJob::run), owner(sched), fn(body), pending(counter),
+     begin(lo), end(hi), grain(minSize) { }
+
+    static void run(H::Job* job) {
+      auto* const self = static_cast<RangeJob*>(job);
+      H::WorkDeque& deque = self->owner->localDeque();
+      H::inl_szt_ lo = self->begin, hi = self->end;
+      while(hi - lo > self->grain && deque.size() < 2) {
+        const H::inl_szt_ mid = lo + (hi - lo) / 2;
+        self->pending->fetch_add(1, std::memory_order_relaxed);
+        self->owner->push(new RangeJob(self->owner, self->fn,
+          self->pending, mid, hi, self->grain));
+        hi = mid;
+      }
+      for(H::inl_szt_ i = lo; i < hi; ++i)
+        (*self->fn)(i);
+      std::atomic<std::uint32_t>* const pending = self->pending;
+      delete self;
+      if(pending->fetch_sub(1, std::memory_order_acq_rel) == 1)
+        atomicNotifyAll(pending);
+    }
+
+    Scheduler* owner;
+    Fn* fn;
+    std::atomic<std::uint32_t>* pending;
+    H::inl_szt_ begin;
+    H::inl_szt_ end;
+    H::inl_szt_ grain;
+  };
+
+  static Current& current() NOEXCEPT {
+    static THREAD_LOCAL Current current { nullptr, 0 };
+    return current;
+  }
+
+  bool isWorker() const NOEXCEPT
+  { return Scheduler::current().owner == this; }
+
+  H::WorkDeque& localDeque() NOEXCEPT
+  { return workers_[Scheduler::current().index].deque; }
+
+  /// Orders victims by shared last-level cache, then node.
+  void planVictims(const Topology& topology) {
+    const CacheInfo* last = nullptr;
+    for(const CacheInfo& cache : topology.caches()) {
+      if(cache.type != CacheType::INSTRUCTION &&
+        (!last || cache.level >= last->level))
+        last = &cache;
+    }
+    auto sameCache = [&](int a, int b) -> bool {
+      if(!last || a < 0 || b < 0)
+        return false;
+      for(const CacheInfo& cache : topology.caches()) {
+        if(cache.level != last->level ||
+          cache.type == CacheType::INSTRUCTION)
+          continue;
+        const auto& cpus = cache.sharedCpus;
+        const bool hasA = std::find(cpus.begin(), cpus.end(),
+          unsigned(a)) != cpus.end();
+        const bool hasB = std::find(cpus.begin(), cpus.end(),
+          unsigned(b)) != cpus.end();
+        if(hasA || hasB)
+          return hasA && hasB;
+      }
+      return false;
+    };
+    auto sameNode = [&](int a, int b) -> bool {
+      if(a < 0 || b < 0)
+        return true;
+      const CpuInfo* const ca = topology.findCpu(unsigned(a));
+      const CpuInfo* const cb = topology.findCpu(unsigned(b));
+      return ca && cb && ca->node == cb->node;
+    };
+
+    for(unsigned i = 0; i < count_; ++i) {
+      Worker& worker = workers_[i];
+      std::vector<unsigned> tiers[3];
+      for(unsigned j = 0; j < count_; ++j) {
+        if(j == i)
+          continue;
+        const int a = worker.cpu, b = workers_[j].cpu;
+        const unsigned tier = sameCache(a, b) ? 0 : sameNode(a, b) ? 1 : 2;
+        tiers[tier].push_back(j);
+      }
+      for(const auto& tier : tiers) {
+        if(tier.empty())
+          continue;
+        worker.victims.insert(worker.victims.end(), tier.begin(), tier.end());
+        worker.tierEnds.push_back(unsigned(worker.victims.size()));
+      }
+    }
+  }
+
+  /// Pushes locally from a worker, otherwise through the injection queue.
+  void enqueue(H::Job* job) {
+    if(this->isWorker()) {
+      this->push(job);
+      return;
+    }
+    {
+      std::lock_guard<SpinLock> guard(injectLock_);
+      injected_.push_back(job);
+    }
+    injectCount_.fetch_add(1, std::memory_order_release);
+    this->wake();
+  }
+
+  void push(H::Job* job) {
+    this->localDeque().push(job);
+    this->wake();
+  }
+
+  /// Wakes a parked worker, if there are any.
+  void wake() NOEXCEPT {
+    // Pairs with the fence in `park`, so either side sees the other.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(sleepers_.load(std::memory_order_relaxed) != 0) {
+      epoch_.fetch_add(1, std::memory_order_release);
+      atomicNotifyOne(&epoch_);
+    }
+  }
+
+  H::Job* takeInjected() {
+    if(injectCount_.load(std::memory_order_acquire) == 0)
+      return nullptr;
+    std::lock_guard<SpinLock> guard(injectLock_);
+    if(injected_.empty())
+      return nullptr;
+    H::Job* const job = injected_.front();
+    injected_.pop_front();
+    injectCount_.fetch_sub(1, std::memory_order_relaxed);
+    return job;
+  }
+
+  /// Steals tier by tier, starting at a random victim within each.
+  H::Job* stealFrom(Worker& worker) NOEXCEPT {
+    unsigned start = 0;
+    for(unsigned end : worker.tierEnds) {
+      const unsigned size = end - start;
+      worker.seed ^= worker.seed << 13;
+      worker.seed ^= worker.seed >> 17;
+      worker.seed ^= worker.seed << 5;
+      const unsigned offset = worker.seed % size;
+      for(unsigned n = 0; n < size; ++n) {
+        const unsigned victim = worker.victims[start + (offset + n) % size];
+        if(H::Job* job = workers_[victim].deque.steal())
+          return job;
+      }
+      start = end;
+    }
+    return nullptr;
+  }
+
+  H::Job* findJob(unsigned index) {
+    Worker& worker = workers_[index];
+    if(H::Job* job = worker.deque.pop())
+      return job;
+    if(H::Job* job = this->stealFrom(worker))
+      return job;
+    return this->takeInjected();
+  }
+
+  /// Runs other jobs until `pending` drains, used for nested loops.
+  void helpUntil(const std::atomic<std::uint32_t>& pending) {
+    const unsigned index = Scheduler::current().index;
+    Backoff backoff;
+    while(pending.load(std::memory_order_acquire) != 0) {
+      if(H::Job* job = this->findJob(index)) {
+        job->invoke(job);
+        backoff.reset();
+      } else {
+        backoff.pause();
+      }
+    }
+  }
+
+  /// Parks until `epoch_` moves, unless work showed up meanwhile.
+  void park(unsigned index) {
+    const std::uint32_t epoch = epoch_.load(std::memory_order_acquire);
+    sleepers_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    H::Job* const job = this->findJob(index);
+    if(job) {
+      sleepers_.fetch_sub(1, std::memory_order_relaxed);
+      job->invoke(job);
+      return;
+    }
+    if(!stop_.load(std::memory_order_acquire))
+      atomicWait(&epoch_, epoch);
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  void workerMain(unsigned index) {
+    Scheduler::current() = Current { this, index };
+    Worker& worker = workers_[index];
+    if(worker.cpu >= 0)
+      (void) thread::setAffinity(unsigned(worker.cpu));
+    (void) thread::setName("efl-worker");
+
+    Backoff backoff;
+    for(;;) {
+      if(H::Job* job = this->findJob(index)) {
+        job->invoke(job);
+        backoff.reset();
+        continue;
+      }
+      if(stop_.load(std::memory_order_acquire))
+        break;
+      if(backoff.tryPause())
+        continue;
+      this->park(index);
+      backoff.reset();
+    }
+    Scheduler::current() = Current { nullptr, 0 };
+  }
+
+private:
+  Worker* workers_ = nullptr;
+  unsigned count_ = 0;
+  alignas(Arch::destructiveInterference)
+    std::atomic<std::uint32_t> epoch_ { 0 };
+  std::atomic<unsigned> sleepers_ { 0 };
+  std::atomic<bool> stop_ { false };
+  alignas(Arch::destructiveInterference)
+    std::atomic<H::inl_szt_> injectCount_ { 0 };
+  SpinLock injectLock_;
+  std::deque<H::Job*> injected_;
+};
+
+} // namespace config
+} // namespace efl
+
+#endif // EFL_SCHEDULER_HPP
@@ -0,0 +1,635 @@
+//===- efl/Simd.hpp -------------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides vectorized byte search kernels.
+//  Picks SSE2/SSE4.2/AVX2/AVX-512BW on x86 (at runtime unless the
+//  build targets x86-64-v4), NEON on AArch64, and SWAR elsewhere.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_SIMD_HPP
+#define EFL_SIMD_HPP
+
+#include <efl/CpuFeatures.hpp>
+#include <cstdint>
+#include <cstring>
+
+#if (defined(ARCH_AMD64) || defined(ARCH_x86_32)) && \
+  (defined(__GNUC__) || defined(EFLI_MSVC_))
+# include <immintrin.h>
+# define EFLI_SIMD_X86_ 1
+# if defined(__GNUC__)
+#  define EFLI_SIMD_SSE2_   __attribute__((target("sse2")))
+#  define EFLI_SIMD_SSE42_  __attribute__((target("sse4.2")))
+#  define EFLI_SIMD_AVX2_   __attribute__((target("avx2")))
+#  define EFLI_SIMD_AVX512_ __attribute__((target("avx512f,avx512bw,popcnt")))
+# else
+#  define EFLI_SIMD_SSE2_
+#  define EFLI_SIMD_SSE42_
+#  define EFLI_SIMD_AVX2_
+#  define EFLI_SIMD_AVX512_
+# endif
+#elif defined(ARCH_ARM64) && EFL_ARCH_HAS_NEON
+# include <arm_neon.h>
+# define EFLI_SIMD_NEON_ 1
+#endif
+
+#ifndef EFL_SIMD_DISPATCH
+/// If kernels are picked from `CpuFeatures` rather than the target flags.
+# if defined(EFLI_SIMD_X86_) && (MICROARCH_CURR < VMICROARCH_X86_V4)
+#  define EFL_SIMD_DISPATCH 1
+# else
+#  define EFL_SIMD_DISPATCH 0
+# endif
+#endif
+
+namespace efl {
+namespace config {
+namespace simd {
+
+/**
+ * A set of bytes for `findAnyOf`. Building one precomputes the
+ * lookup tables, so reuse it across calls.
+ */
+class ByteSet {
+public:
+  ByteSet() = default;
+
+  ByteSet(const char* chars, H::inl_szt_ count) NOEXCEPT {
+    for(H::inl_szt_ i = 0; i < count; ++i)
+      this->insert(static_cast<unsigned char>(chars[i]));
+    this->buildNibbles();
+  }
+
+  /// From a null terminated string.
+  explicit ByteSet(const char* chars) NOEXCEPT
+   : ByteSet(chars, std::strlen(chars)) { }
+
+  bool contains(unsigned char byte) const NOEXCEPT {
+    return (bits_[byte >> 6] >> (byte & 63)) & 1;
+  }
+
+  /// Distinct bytes in the set.
+  H::inl_szt_ size() const NOEXCEPT { return count_; }
+  /// The first 16 distinct bytes, all of them if `size() <= 16`.
+  const char* chars() const NOEXCEPT { return chars_; }
+
+  /**
+   * Tables for a two shuffle lookup: `b` is in the set iff
+   * `low[b & 15] & high[b >> 4]` is nonzero. Only exact when the
+   * set spans at most 8 distinct high nibbles (true for ASCII
+   * punctuation and whitespace), check `hasNibbleTables()`.
+   */
+  bool hasNibbleTables() const NOEXCEPT { return nibble_; }
+  const unsigned char* nibbleLow() const NOEXCEPT { return low_; }
+  const unsigned char* nibbleHigh() const NOEXCEPT { return high_; }
+
+private:
+  void insert(unsigned char byte) NOEXCEPT {
+    if(this->contains(byte))
+      return;
+    bits_[byte >> 6] |= std::uint64_t(1) << (byte & 63);
+    if(count_ < 16)
+      chars_[count_] = static_cast<char>(byte);
+    ++count_;
+  }
+
+  void buildNibbles() NOEXCEPT {
+    unsigned classes = 0;
+    for(unsigned hi = 0; hi < 16; ++hi) {
+      if(!((bits_[hi >> 2] >> ((hi & 3) * 16)) & 0xFFFF))
+        continue;
+      if(classes == 8) {
+        nibble_ = false;
+        return;
+      }
+      high_[hi] = static_cast<unsigned char>(1u << classes++);
+    }
+    for(unsigned byte = 0; byte < 256; ++byte) {
+      if(this->contains(static_cast<unsigned char>(byte)))
+        low_[byte & 15] |= high_[byte >> 4];
+    }
+    nibble_ = true;
+  }
+
+private:
+  std::uint64_t bits_[4] = { };
+  alignas(16) unsigned char low_[16] = { };
+  alignas(16) unsigned char high_[16] = { };
+  alignas(16) char chars_[16] = { };
+  H::inl_szt_ count_ = 0;
+  bool nibble_ = false;
+};
+
+} // namespace simd
+
+namespace H {
+  ALWAYS_INLINE unsigned simdFirstBit(std::uint64_t mask) NOEXCEPT {
+#if defined(EFLI_MSVC_) && defined(ARCH_AMD64)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return unsigned(index);
+#elif defined(EFLI_MSVC_)
+    unsigned long index;
+    if(_BitScanForward(&index, unsigned(mask)))
+      return unsigned(index);
+    _BitScanForward(&index, unsigned(mask >> 32));
+    return unsigned(index) + 32;
+#else
+    return unsigned(__builtin_ctzll(mask));
+#endif
+  }
+
+  ALWAYS_INLINE unsigned simdBitCount(std::uint64_t mask) NOEXCEPT {
+#if defined(EFLI_MSVC_) || !defined(__GNUC__)
+    mask = mask - ((mask >> 1) & 0x5555555555555555ull);
+    mask = (mask & 0x3333333333333333ull) + ((mask >> 2) & 0x3333333333333333ull);
+    mask = (mask + (mask >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return unsigned((mask * 0x0101010101010101ull) >> 56);
+#else
+    return unsigned(__builtin_popcountll(mask));
+#endif
+  }
+
+  //=== SWAR ===//
+
+  constexpr std::uint64_t swarOnes = 0x0101010101010101ull;
+  constexpr std::uint64_t swarHigh = 0x8080808080808080ull;
+
+  /// Eight bytes, the first in the low bits whatever the endianness.
+  ALWAYS_INLINE std::uint64_t swarLoad(const char* p) NOEXCEPT {
+    std::uint64_t out;
+    std::memcpy(&out, p, sizeof(out));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    out = __builtin_bswap64(out);
+#endif
+    return out;
+  }
+
+  /// High bit set in exactly the zero bytes, no borrows between lanes.
+  ALWAYS_INLINE std::uint64_t swarZeroBytes(std::uint64_t x) NOEXCEPT {
+    const std::uint64_t low = ~swarHigh;
+    return ~(((x & low) + low) | x) & swarHigh;
+  }
+
+  inline const char* findByteSwar(const char* p,
+   inl_szt_ n, char byte) NOEXCEPT {
+    const std::uint64_t needle = swarOnes * static_cast<unsigned char>(byte);
+    for(; n >= 8; n -= 8, p += 8) {
+      const std::uint64_t mask = swarZeroBytes(swarLoad(p) ^ needle);
+      if(mask)
+        return p + (simdFirstBit(mask) >> 3);
+    }
+    for(; n; --n, ++p) {
+      if(*p == byte)
+        return p;
+    }
+    return nullptr;
+  }
+
+  inline inl_szt_ countByteSwar(const char* p,
+   inl_szt_ n, char byte) NOEXCEPT {
+    const std::uint64_t needle = swarOnes * static_cast<unsigned char>(byte);
+    inl_szt_ count = 0;
+    for(; n >= 8; n -= 8, p += 8)
+      count += simdBitCount(swarZeroBytes(swarLoad(p) ^ needle));
+    for(; n; --n, ++p)
+      count += (*p == byte);
+    return count;
+  }
+
+  inline const char* findNonAsciiSwar(const char* p, inl_szt_ n) NOEXCEPT {
+    for(; n >= 8; n -= 8, p += 8) {
+      const std::uint64_t mask = swarLoad(p) & swarHigh;
+      if(mask)
+        return p + (simdFirstBit(mask) >> 3);
+    }
+    for(; n; --n, ++p) {
+      if(static_cast<unsigned char>(*p) & 0x80)
+        return p;
+    }
+    return nullptr;
+  }
+
+  inline const char* findAnyOfSwar(const char* p,
+   inl_szt_ n, const simd::ByteSet& set) NOEXCEPT {
+    for(; n; --n, ++p) {
+      if(set.contains(static_cast<unsigned char>(*p)))
+        return p;
+    }
+    return nullptr;
+  }
+
+#if defined(EFLI_SIMD_X86_)
+  //=== SSE2 ===//
+
+  ALWAYS_INLINE EFLI_SIMD_SSE2_ __m128i simdLoad128(const void* p) NOEXCEPT
+  { return _mm_loadu_si128(static_cast<const __m128i*>(p)); }
+
+  EFLI_SIMD_SSE2_ inline const char* findByteSse2(const char* p,
+   inl_szt_ n, char byte) NOEXCEPT {
+    const __m128i needle = _mm_set1_epi8(byte);
+    for(; n >= 16; n -= 16, p += 16) {
+      const unsigned mask = unsigned(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(simdLoad128(p), needle)));
+      if(mask)
+        return p + simdFirstBit(mask);
+    }
+    return findByteSwar(p, n, byte);
+  }
+
+  /**
+   * Matches are subtracted as -1s into byte counters, which are
+   * summed with `psadbw` before they can overflow.
+   */
+  EFLI_SIMD_SSE2_ inline inl_szt_ countByteSse2(const char* p,
+   inl_szt_ n, char byte) NOEXCEPT {
+    const __m128i needle = _mm_set1_epi8(byte);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i total = zero;
+    while(n >= 16) {
+      __m128i counts = zero;
+      for(int i = 0; i < 255 && n >= 16; ++i, n -= 16, p += 16)
+        counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(simdLoad128(p), needle));
+      total = _mm_add_epi64(total, _mm_sad_epu8(counts, zero));
+    }
+    const auto lanes = reinterpret_cast<const std::uint64_t*>(&total);
+    return inl_szt_(lanes[0] + lanes[1]) + countByteSwar(p, n, byte);
+  }
+
+  EFLI_SIMD_SSE2_ inline const char* findNonAsciiSse2(const char* p,
+   inl_szt_ n) NOEXCEPT {
+    for(; n >= 16; n -= 16, p += 16) {
+      const unsigned mask = unsigned(_mm_movemask_epi8(simdLoad128(p)));
+      if(mask)
+        return p + simdFirstBit(mask);
+    }
+    return findNonAsciiSwar(p, n);
+  }
+
+  /// One compare per byte in the set, so only used for small sets.
+  EFLI_SIMD_SSE2_ inline const char* findAnyOfSse2(const char* p,
+   inl_szt_ n, const simd::ByteSet& set) NOEXCEPT {
+    const inl_szt_ count = set.size();
+    if(count > 16)
+      return findAnyOfSwar(p, n, set);
+    __m128i needles[16];
+    for(inl_szt_ i = 0; i < count; ++i)
+      needles[i] = _mm_set1_epi8(set.chars()[i]);
+    for(; n >= 16; n -= 16, p += 16) {
+      const __m128i v = simdLoad128(p);
+      __m128i hits = _mm_setzero_si128();
+      for(inl_szt_ i = 0; i < count; ++i)
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, needles[i]));
+      const unsigned mask = unsigned(_mm_movemask_epi8(hits));
+      if(mask)
+        return p + simdFirstBit(mask);
+    }
+    return findAnyOfSwar(p, n, set);
+  }
+
+  //=== SSE4.2 ===//
+
+  /// Nibble lookup with `pshufb`, falls back to `pcmpestri`.
+  EFLI_SIMD_SSE42_ inline const char* findAnyOfSse42(const char* p,
+   inl_szt_ n, const simd::ByteSet& set) NOEXCEPT {
+    if(set.hasNibbleTables()) {
+      const __m128i low = _mm_load_si128(
+        reinterpret_cast<const __m128i*>(set.nibbleLow()));
+      const __m128i high = _mm_load_si128(
+        reinterpret_cast<const __m128i*>(set.nibbleHigh()));
+      const __m128i nibble = _mm_set1_epi8(0x0F);
+      for(; n >= 16; n -= 16, p += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i lo = _mm_shuffle_epi8(low, _mm_and_si128(v, nibble));
+        const __m128i hi = _mm_shuffle_epi8(high,
+          _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        const __m128i miss = _mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128());
+        const unsigned mask = ~unsigned(_mm_movemask_epi8(miss)) & 0xFFFF;
+        if(mask)
+          return p + simdFirstBit(mask);
+      }
+    } else if(set.size() <= 16) {
+      const __m128i needles = _mm_load_si128(
+        reinterpret_cast<const __m128i*>(set.chars()));
+      const int count = int(set.size());
+      for(; n >= 16; n -= 16, p += 16) {
+        const int index = _mm_cmpestri(needles, count,
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), 16,
+          _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if(index < 16)
+          return p + index;
+      }
+    }
+    return findAnyOfSwar(p, n, set);
+  }
+
+  //=== AVX2 ===//
+
+  ALWAYS_INLINE EFLI_SIMD_AVX2_ __m256i simdLoad256(const void* p) NOEXCEPT
+  { return _mm256_loadu_si256(static_cast<const __m256i*>(p)); }
+
+  EFLI_SIMD_AVX2_ inline const char* findByteAvx2(const char* p,
+   inl_szt_ n, char byte) NOEXCEPT {
+    const __m256i needle = _mm256_set1_epi8(byte);
+    for(; n >= 32; n -= 32, p += 32) {
+      const unsigned mask = unsigned(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(simdLoad256(p), needle)));
+      if(mask)
+        return p + simdFirstBit(mask);
+    }
+    return findByteSwar(p, n, byte);
+  }
+
+  EFLI_SIMD_AVX2_ inline inl_szt_ countByteAvx2(const char* p,
+   inl_szt_ n, char byte) NOEXCEPT {
+    const __m256i needle = _mm256_set1_epi8(byte);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i total = zero;
+    while(n >= 32) {
+      __m256i counts = zero;
+      for(int i = 0; i < 255 && n >= 32; ++i, n -= 32, p += 32)
+        counts = _mm256_sub_epi8(counts, _mm256_cmpeq_epi8(simdLoad256(p), needle));
+      total = _mm256_add_epi64(total, _mm256_sad_epu8(counts, zero));
+    }
+    const auto lanes = reinterpret_cast<const std::uint64_t*>(&total);
+    return inl_szt_(lanes[0] + lanes[1] + lanes[2] + lanes[3])
+      + countByteSwar(p, n, byte);
+  }
+
+  EFLI_SIMD_AVX2_ inline const char* findNonAsciiAvx2(const char* p,
+   inl_szt_ n) NOEXCEPT {
+    for(; n >= 32; n -= 32, p += 32) {
+      const unsigned mask = unsigned(_mm256_movemask_epi8(simdLoad256(p)));
+      if(mask)
+        return p + simdFirstBit(mask);
+    }
+    return findNonAsciiSwar(p, n);
+  }
+
+  EFLI_SIMD_AVX2_ inline const char* findAnyOfAvx2(const char* p,
+   inl_szt_ n, const simd::ByteSet& set) NOEXCEPT {
+    if(!set.hasNibbleTables())
+      return findAnyOfSse42(p, n, set);
+    const __m256i low = _mm256_broadcastsi128_si256(_mm_load_si128(
+      reinterpret_cast<const __m128i*>(set.nibbleLow())));
+    const __m256i high = _mm256_broadcastsi128_si256(_mm_load_si128(
+      reinterpret_cast<const __m128i*>(set.nibbleHigh())));
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    for(; n >= 32; n -= 32, p += 32) {
+      const __m256i v = simdLoad256(p);
+      const __m256i lo = _mm256_shuffle_epi8(low, _mm256_and_si256(v, nibble));
+      const __m256i hi = _mm256_shuffle_epi8(high,
+        _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+      const __m256i miss = _mm256_cmpeq_epi8(
+        _mm256_and_si256(lo, hi), _mm256_setzero_si256());
+      const unsigned mask = ~unsigned(_mm256_movemask_epi8(miss));
+      if(mask)
+        return p + simdFirstBit(mask);
+    }
+    return findAnyOfSse42(p, n, set);
+  }
+
+  //=== AVX-512BW ===//
+
+  /// Mask of the first `n` lanes, for loads that can't fault past the end.
+  ALWAYS_INLINE std::uint64_t simdTailMask(inl_szt_ n) NOEXCEPT
+  { return (n >= 64) ? ~std::uint64_t(0) : ((std::uint64_t(1) << n) - 1); }
+
+  EFLI_SIMD_AVX512_ inline const char* findByteAvx512(const char* p,
+   inl_szt_ n, char byte) NOEXCEPT {
+    const __m512i needle = _mm512_set1_epi8(byte);
+    for(; n >= 64; n -= 64, p += 64) {
+      const std::uint64_t mask = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(p), needle);
+      if(mask)
+        return p + simdFirstBit(mask);
+    }
+    const __mmask64 tail = simdTailMask(n);
+    const std::uint64_t mask = _mm512_mask_cmpeq_epi8_mask(
+      tail, _mm512_maskz_loadu_epi8(tail, p), needle);
+    return mask ? (p + simdFirstBit(mask)) : nullptr;
+  }
+
+  EFLI_SIMD_AVX512_ inline inl_szt_ countByteAvx512(const char* p,
+   inl_szt_ n, char byte) NOEXCEPT {
+    const __m512i needle = _mm512_set1_epi8(byte);
+    inl_szt_ count = 0;
+    for(; n >= 64; n -= 64, p += 64)
+      count += simdBitCount(_mm512_cmpeq_epi8_mask(_mm512_loadu_si512(p), needle));
+    const __mmask64 tail = simdTailMask(n);
+    return count + simdBitCount(_mm512_mask_cmpeq_epi8_mask(
+      tail, _mm512_maskz_loadu_epi8(tail, p), needle));
+  }
+
+  EFLI_SIMD_AVX512_ inline const char* findNonAsciiAvx512(const char* p,
+   inl_szt_ n) NOEXCEPT {
+    for(; n >= 64; n -= 64, p += 64) {
+      const std::uint64_t mask = _mm512_movepi8_mask(_mm512_loadu_si512(p));
+      if(mask)
+        return p + simdFirstBit(mask);
+    }
+    const std::uint64_t mask = _mm512_movepi8_mask(
+      _mm512_maskz_loadu_epi8(simdTailMask(n), p));
+    return mask ? (p + simdFirstBit(mask)) : nullptr;
+  }
+
+  EFLI_SIMD_AVX512_ inline const char* findAnyOfAvx512(const char* p,
+   inl_szt_ n, const simd::ByteSet& set) NOEXCEPT {
+    if(!set.hasNibbleTables())
+      return findAnyOfSse42(p, n, set);
+    // The unmasked broadcast trips GCC's uninitialized warnings.
+    const __m512i low = _mm512_maskz_broadcast_i32x4(0xFFFF, _mm_load_si128(
+      reinterpret_cast<const __m128i*>(set.nibbleLow())));
+    const __m512i high = _mm512_maskz_broadcast_i32x4(0xFFFF, _mm_load_si128(
+      reinterpret_cast<const __m128i*>(set.nibbleHigh())));
+    const __m512i nibble = _mm512_set1_epi8(0x0F);
+    for(;;) {
+      const __mmask64 tail = simdTailMask(n);
+      const __m512i v = _mm512_maskz_loadu_epi8(tail, p);
+      const __m512i lo = _mm512_shuffle_epi8(low, _mm512_and_si512(v, nibble));
+      const __m512i hi = _mm512_shuffle_epi8(high,
+        _mm512_and_si512(_mm512_srli_epi16(v, 4), nibble));
+      const std::uint64_t mask = _mm512_mask_test_epi8_mask(tail, lo, hi);
+      if(mask)
+        return p + simdFirstBit(mask);
+      if(n <= 64)
+        return nullptr;
+      n -= 64, p += 64;
+    }
+  }
+#endif // EFLI_SIMD_X86_
+
+#if defined(EFLI_SIMD_NEON_)
+  //=== NEON ===//
+
+  /// `shrn` packs a byte mask into 4 bits per byte, NEON has no `movemask`.
+  ALWAYS_INLINE std::uint64_t simdNibbleMask(uint8x16_t bytes) NOEXCEPT {
+    return vget_lane_u64(vreinterpret_u64_u8(
+      vshrn_n_u16(vreinterpretq_u16_u8(bytes), 4)), 0);
+  }
+
+  inline const char* findByteNeon(const char* p,
+   inl_szt_ n, char byte) NOEXCEPT {
+    const uint8x16_t needle = vdupq_n_u8(static_cast<unsigned char>(byte));
+    for(; n >= 16; n -= 16, p += 16) {
+      const auto v = vld1q_u8(reinterpret_cast<const std::uint8_t*>(p));
+      const std::uint64_t mask = simdNibbleMask(vceqq_u8(v, needle));
+      if(mask)
+        return p + (simdFirstBit(mask) >> 2);
+    }
+    return findByteSwar(p, n, byte);
+  }
+
+  inline inl_szt_ countByteNeon(const char* p,
+   inl_szt_ n, char byte) NOEXCEPT {
+    const uint8x16_t needle = vdupq_n_u8(static_cast<unsigned char>(byte));
+    inl_szt_ count = 0;
+    while(n >= 16) {
+      uint8x16_t counts = vdupq_n_u8(0);
+      for(int i = 0; i < 255 && n >= 16; ++i, n -= 16, p += 16) {
+        const auto v = vld1q_u8(reinterpret_cast<const std::uint8_t*>(p));
+        counts = vsubq_u8(counts, vceqq_u8(v, needle));
+      }
+      count += vaddlvq_u8(counts);
+    }
+    return count + countByteSwar(p, n, byte);
+  }
+
+  inline const char* findNonAsciiNeon(const char* p, inl_szt_ n) NOEXCEPT {
+    for(; n >= 16; n -= 16, p += 16) {
+      const auto v = vld1q_u8(reinterpret_cast<const std::uint8_t*>(p));
+      if(vmaxvq_u8(v) < 0x80)
+        continue;
+      const std::uint64_t mask = simdNibbleMask(vcgeq_u8(v, vdupq_n_u8(0x80)));
+      return p + (simdFirstBit(mask) >> 2);
+    }
+    return findNonAsciiSwar(p, n);
+  }
+
+  inline const char* findAnyOfNeon(const char* p,
+   inl_szt_ n, const simd::ByteSet& set) NOEXCEPT {
+    if(!set.hasNibbleTables())
+      return findAnyOfSwar(p, n, set);
+    const uint8x16_t low = vld1q_u8(set.nibbleLow());
+    const uint8x16_t high = vld1q_u8(set.nibbleHigh());
+    for(; n >= 16; n -= 16, p += 16) {
+      const auto v = vld1q_u8(reinterpret_cast<const std::uint8_t*>(p));
+      const uint8x16_t lo = vqtbl1q_u8(low, vandq_u8(v, vdupq_n_u8(0x0F)));
+      const uint8x16_t hi = vqtbl1q_u8(high, vshrq_n_u8(v, 4));
+      const std::uint64_t mask = simdNibbleMask(vtstq_u8(lo, hi));
+      if(mask)
+        return p + (simdFirstBit(mask) >> 2);
+    }
+    return findAnyOfSwar(p, n, set);
+  }
+#endif // EFLI_SIMD_NEON_
+
+  struct SimdKernels {
+    const char*(*findByte)(const char*, inl_szt_, char);
+    const char*(*findAnyOf)(const char*, inl_szt_, const simd::ByteSet&);
+    inl_szt_(*countByte)(const char*, inl_szt_, char);
+    const char*(*findNonAscii)(const char*, inl_szt_);
+  };
+
+#if EFL_SIMD_DISPATCH
+  /// The widest kernels the running CPU supports, picked once.
+  inline const SimdKernels& simdKernels() {
+    static const SimdKernels kernels = []() -> SimdKernels {
+      const CpuFeatures& features = CpuFeatures::query();
+# if defined(EFLI_SIMD_X86_)
+      if(features.avx512bw)
+        return SimdKernels { &findByteAvx512, &findAnyOfAvx512,
+          &countByteAvx512, &findNonAsciiAvx512 };
+      if(features.avx2 && features.sse42)
+        return SimdKernels { &findByteAvx2, &findAnyOfAvx2,
+          &countByteAvx2, &findNonAsciiAvx2 };
+      if(features.sse42)
+        return SimdKernels { &findByteSse2, &findAnyOfSse42,
+          &countByteSse2, &findNonAsciiSse2 };
+      if(features.sse2)
+        return SimdKernels { &findByteSse2, &findAnyOfSse2,
+          &countByteSse2, &findNonAsciiSse2 };
+# endif
+      (void)features;
+      return SimdKernels { &findByteSwar, &findAnyOfSwar,
+        &countByteSwar, &findNonAsciiSwar };
+    }();
+    return kernels;
+  }
+# define EFLI_SIMD_KERNEL_(name, isa) H::simdKernels().name
+#else
+# define EFLI_SIMD_KERNEL_(name, isa) H::EFL_CAT(name, isa)
+#endif
+
+// Only used when not dispatching, the widest set the build targets.
+// SSE4.2 only adds `findAnyOf`, so callers name their SSE4.2 kernel.
+#if defined(EFLI_SIMD_X86_) && EFL_ARCH_HAS_AVX512BW
+# define EFLI_SIMD_ISA_(sse42) Avx512
+#elif defined(EFLI_SIMD_X86_) && EFL_ARCH_HAS_AVX2 && EFL_ARCH_HAS_SSE42
+# define EFLI_SIMD_ISA_(sse42) Avx2
+#elif defined(EFLI_SIMD_X86_) && EFL_ARCH_HAS_SSE42
+# define EFLI_SIMD_ISA_(sse42) sse42
+#elif defined(EFLI_SIMD_X86_) && EFL_ARCH_HAS_SSE2
+# define EFLI_SIMD_ISA_(sse42) Sse2
+#elif defined(EFLI_SIMD_NEON_)
+# define EFLI_SIMD_ISA_(sse42) Neon
+#else
+# define EFLI_SIMD_ISA_(sse42) Swar
+#endif
+} // namespace H
+
+namespace simd {
+
+/// The first `byte` in `[data, data + size)`, or null.
+inline const char* findByte(const char* data,
+ H::inl_szt_ size, char byte) NOEXCEPT {
+  return EFLI_SIMD_KERNEL_(findByte, EFLI_SIMD_ISA_(Sse2))(data, size, byte);
+}
+
+/// The first byte in `set`, or null.
+inline const char* findAnyOf(const char* data,
+ H::inl_szt_ size, const ByteSet& set) NOEXCEPT {
+  return EFLI_SIMD_KERNEL_(findAnyOf, EFLI_SIMD_ISA_(Sse42))(data, size, set);
+}
+
+/// How many times `byte` occurs.
+inline H::inl_szt_ countByte(const char* data,
+ H::inl_szt_ size, char byte) NOEXCEPT {
+  return EFLI_SIMD_KERNEL_(countByte, EFLI_SIMD_ISA_(Sse2))(data, size, byte);
+}
+
+/// The first byte with the high bit set (not 7-bit ASCII), or null.
+inline const char* findFirstNonAscii(const char* data,
+ H::inl_szt_ size) NOEXCEPT {
+  return EFLI_SIMD_KERNEL_(findNonAscii, EFLI_SIMD_ISA_(Sse2))(data, size);
+}
+
+} // namespace simd
+} // namespace config
+} // namespace efl
+
+#undef EFLI_SIMD_X86_
+#undef EFLI_SIMD_NEON_
+#undef EFLI_SIMD_SSE2_
+#undef EFLI_SIMD_SSE42_
+#undef EFLI_SIMD_AVX2_
+#undef EFLI_SIMD_AVX512_
+#undef EFLI_SIMD_KERNEL_
+#undef EFLI_SIMD_ISA_
+
+#endif // EFL_SIMD_HPP
@@ -0,0 +1,187 @@
+//===- efl/SpscRing.hpp ---------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides a bounded single-producer single-consumer queue.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_SPSC_RING_HPP
+#define EFL_SPSC_RING_HPP
+
+#include <efl/Config.hpp>
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace efl {
+namespace config {
+
+/**
+ * A wait-free ring buffer for exactly one producer and one consumer.
+ * Each side keeps a cached copy of the other's index, so the shared
+ * index lines are only touched when the ring looks full or empty.
+ * With a trivially copyable `T`, it can live in shared memory
+ * (see `create` and `attach`). Over-aligned, so heap allocation
+ * needs C++17 aligned `new` or `alignedAlloc`.
+ */
+template <typename T, H::inl_szt_ N>
+class SpscRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0,
+    "`N` must be a power of two.");
+
+  using Index = H::inl_szt_;
+  static constexpr Index mask = N - 1;
+  static constexpr Index padding = Arch::destructiveInterference;
+
+public:
+  using value_type = T;
+  static constexpr Index capacity = N;
+
+public:
+  SpscRing() = default;
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  ~SpscRing() {
+    if(!std::is_trivially_destructible<T>::value) {
+      const Index tail = prod_.tail.load(std::memory_order_acquire);
+      for(Index i = cons_.head.load(std::memory_order_relaxed); i != tail; ++i)
+        this->slot(i)->~T();
+    }
+  }
+
+  /// Constructs a ring in `mem`, which must be suitably aligned.
+  static SpscRing* create(void* mem) NOEXCEPT {
+    static_assert(std::is_trivially_copyable<T>::value,
+      "Shared rings require a trivially copyable `T`.");
+    return ::new(mem) SpscRing();
+  }
+
+  /// Uses a ring previously made with `create`, eg. from another process.
+  static SpscRing* attach(void* mem) NOEXCEPT {
+    static_assert(std::is_trivially_copyable<T>::value,
+      "Shared rings require a trivially copyable `T`.");
+    return static_cast<SpscRing*>(mem);
+  }
+
+  //=== Producer ===//
+
+  template <typename...Args>
+  NODISCARD bool tryEmplace(Args&&...args) {
+    const Index tail = prod_.tail.load(std::memory_order_relaxed);
+    if(tail - prod_.cachedHead == N) {
+      prod_.cachedHead = cons_.head.load(std::memory_order_acquire);
+      if(tail - prod_.cachedHead == N)
+        return false;
+    }
+    ::new(this->slot(tail)) T(std::forward<Args>(args)...);
+    prod_.tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  NODISCARD bool tryPush(const T& value)
+  { return this->tryEmplace(value); }
+  NODISCARD bool tryPush(T&& value)
+  { return this->tryEmplace(std::move(value)); }
+
+  /// Pushes up to `count` items, returns how many were pushed.
+  Index pushN(const T* values, Index count) {
+    const Index tail = prod_.tail.load(std::memory_order_relaxed);
+    Index space = N - (tail - prod_.cachedHead);
+    if(space < count) {
+      prod_.cachedHead = cons_.head.load(std::memory_order_acquire);
+      space = N - (tail - prod_.cachedHead);
+    }
+    const Index n = (count < space) ? count : space;
+    for(Index i = 0; i < n; ++i)
+      ::new(this->slot(tail + i)) T(values[i]);
+    if(n != 0)
+      prod_.tail.store(tail + n, std::memory_order_release);
+    return n;
+  }
+
+  //=== Consumer ===//
+
+  NODISCARD bool tryPop(T& out) {
+    const Index head = cons_.head.load(std::memory_order_relaxed);
+    if(head == cons_.cachedTail) {
+      cons_.cachedTail = prod_.tail.load(std::memory_order_acquire);
+      if(head == cons_.cachedTail)
+        return false;
+    }
+    T* const item = this->slot(head);
+    out = std::move(*item);
+    item->~T();
+    cons_.head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Pops up to `count` items, returns how many were popped.
+  Index popN(T* out, Index count) {
+    const Index head = cons_.head.load(std::memory_order_relaxed);
+    Index avail = cons_.cachedTail - head;
+    if(avail < count) {
+      cons_.cachedTail = prod_.tail.load(std::memory_order_acquire);
+      avail = cons_.cachedTail - head;
+    }
+    const Index n = (count < avail) ? count : avail;
+    for(Index i = 0; i < n; ++i) {
+      T* const item = this->slot(head + i);
+      out[i] = std::move(*item);
+      item->~T();
+    }
+    if(n != 0)
+      cons_.head.store(head + n, std::memory_order_release);
+    return n;
+  }
+
+  /// Approximate while the other side is active.
+  Index size() const NOEXCEPT {
+    const Index head = cons_.head.load(std::memory_order_acquire);
+    const Index tail = prod_.tail.load(std::memory_order_acquire);
+    return tail - head;
+  }
+
+  bool isEmpty() const NOEXCEPT { return this->size() == 0; }
+
+private:
+  T* slot(Index index) NOEXCEPT {
+    return reinterpret_cast<T*>(storage_) + (index & mask);
+  }
+
+private:
+  /// Written by the consumer.
+  struct alignas(padding) {
+    std::atomic<Index> head { 0 };
+    Index cachedTail = 0;
+  } cons_;
+
+  /// Written by the producer.
+  struct alignas(padding) {
+    std::atomic<Index> tail { 0 };
+    Index cachedHead = 0;
+  } prod_;
+
+  alignas(padding) alignas(T) unsigned char storage_[N * sizeof(T)];
+};
+
+} // namespace config
+} // namespace efl
+
+#endif // EFL_SPSC_RING_HPP
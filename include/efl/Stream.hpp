@@ -0,0 +1,230 @@
+//===- efl/Stream.hpp -----------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides non-temporal (cache bypassing) copy and fill.
+//  The widest vector the target flags allow is picked at compile time.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_STREAM_HPP
+#define EFL_STREAM_HPP
+
+#include <efl/Memory.hpp>
+#include <efl/Topology.hpp>
+#include <cstdint>
+
+#if EFL_ARCH_HAS_AVX512F || EFL_ARCH_HAS_AVX2 || EFL_ARCH_HAS_SSE2
+# include <immintrin.h>
+# if EFL_ARCH_HAS_AVX512F
+#  define EFLI_STREAM_WIDTH_ 64
+# elif EFL_ARCH_HAS_AVX2
+#  define EFLI_STREAM_WIDTH_ 32
+# else
+#  define EFLI_STREAM_WIDTH_ 16
+# endif
+# define EFLI_STREAM_X86_ 1
+#elif defined(ARCH_ARM64) && EFL_ARCH_HAS_NEON && !defined(COMPILER_MSVC)
+# include <arm_neon.h>
+# define EFLI_STREAM_WIDTH_ 32
+# define EFLI_STREAM_STNP_ 1
+#else
+# define EFLI_STREAM_WIDTH_ 0
+#endif
+
+namespace efl {
+namespace config {
+namespace H {
+  /**
+   * Below this many bytes, streaming loses to `memcpy`: the data would
+   * mostly fit in cache anyway and be read back soon.
+   * Half the last-level cache, or `EFL_STREAM_THRESHOLD` if defined.
+   * 1MiB when the cache size is unknown or detection fails.
+   */
+  inline inl_szt_ streamThreshold() NOEXCEPT {
+#if defined(EFL_STREAM_THRESHOLD)
+    return EFL_STREAM_THRESHOLD;
+#else
+    static const inl_szt_ threshold = []() -> inl_szt_ {
+      inl_szt_ last = 0;
+      // Detection allocates and may throw, but callers are `NOEXCEPT`.
+      try {
+        for(const CacheInfo& cache : Topology::query().caches()) {
+          if(cache.type != CacheType::INSTRUCTION && cache.size > last)
+            last = cache.size;
+        }
+      } catch(...) {
+        last = 0;
+      }
+      return last ? (last / 2) : inl_szt_(1) << 20;
+    }();
+    return threshold;
+#endif
+  }
+
+#if defined(EFLI_STREAM_X86_)
+# if EFLI_STREAM_WIDTH_ == 64
+  typedef __m512i StreamVec;
+  ALWAYS_INLINE StreamVec streamLoad(const void* src) NOEXCEPT
+  { return _mm512_loadu_si512(src); }
+  ALWAYS_INLINE StreamVec streamSplat(unsigned char value) NOEXCEPT
+  { return _mm512_set1_epi8(static_cast<char>(value)); }
+  ALWAYS_INLINE void streamStore(void* dst, StreamVec v) NOEXCEPT
+  { _mm512_stream_si512(static_cast<__m512i*>(dst), v); }
+# elif EFLI_STREAM_WIDTH_ == 32
+  typedef __m256i StreamVec;
+  ALWAYS_INLINE StreamVec streamLoad(const void* src) NOEXCEPT
+  { return _mm256_loadu_si256(static_cast<const __m256i*>(src)); }
+  ALWAYS_INLINE StreamVec streamSplat(unsigned char value) NOEXCEPT
+  { return _mm256_set1_epi8(static_cast<char>(value)); }
+  ALWAYS_INLINE void streamStore(void* dst, StreamVec v) NOEXCEPT
+  { _mm256_stream_si256(static_cast<__m256i*>(dst), v); }
+# else
+  typedef __m128i StreamVec;
+  ALWAYS_INLINE StreamVec streamLoad(const void* src) NOEXCEPT
+  { return _mm_loadu_si128(static_cast<const __m128i*>(src)); }
+  ALWAYS_INLINE StreamVec streamSplat(unsigned char value) NOEXCEPT
+  { return _mm_set1_epi8(static_cast<char>(value)); }
+  ALWAYS_INLINE void streamStore(void* dst, StreamVec v) NOEXCEPT
+  { _mm_stream_si128(static_cast<__m128i*>(dst), v); }
+# endif
+  /// Non-temporal stores are weakly ordered, `sfence` restores TSO.
+  ALWAYS_INLINE void streamFence() NOEXCEPT { _mm_sfence(); }
+
+#elif defined(EFLI_STREAM_STNP_)
+  struct StreamVec {
+    uint8x16_t lo;
+    uint8x16_t hi;
+  };
+  ALWAYS_INLINE StreamVec streamLoad(const void* src) NOEXCEPT {
+    const auto* bytes = static_cast<const std::uint8_t*>(src);
+    return StreamVec { vld1q_u8(bytes), vld1q_u8(bytes + 16) };
+  }
+  ALWAYS_INLINE StreamVec streamSplat(unsigned char value) NOEXCEPT {
+    const uint8x16_t v = vdupq_n_u8(value);
+    return StreamVec { v, v };
+  }
+  ALWAYS_INLINE void streamStore(void* dst, StreamVec v) NOEXCEPT {
+    __asm__ __volatile__("stnp %q0, %q1, [%2]"
+      :: "w"(v.lo), "w"(v.hi), "r"(dst) : "memory");
+  }
+  ALWAYS_INLINE void streamFence() NOEXCEPT {
+    __asm__ __volatile__("dmb ishst" ::: "memory");
+  }
+#endif
+
+#if EFLI_STREAM_WIDTH_ != 0
+  constexpr inl_szt_ streamWidth = EFLI_STREAM_WIDTH_;
+
+  /// Bytes until `ptr` is aligned for `streamStore`.
+  ALWAYS_INLINE inl_szt_ streamHead(const void* ptr) NOEXCEPT {
+    const auto addr = reinterpret_cast<std::uintptr_t>(ptr);
+    return (streamWidth - (addr & (streamWidth - 1))) & (streamWidth - 1);
+  }
+
+  // Out of line, the call is noise at these sizes.
+  NOINLINE inline void streamCopyLarge(unsigned char* RESTRICT out,
+   const unsigned char* RESTRICT in, inl_szt_ size) NOEXCEPT {
+    constexpr inl_szt_ width = streamWidth;
+    // Align the destination, stores must not split lines.
+    const inl_szt_ head = streamHead(out);
+    std::memcpy(out, in, head);
+    out += head, in += head, size -= head;
+
+    for(; size >= width * 4; size -= width * 4) {
+      const StreamVec a = streamLoad(in);
+      const StreamVec b = streamLoad(in + width);
+      const StreamVec c = streamLoad(in + width * 2);
+      const StreamVec d = streamLoad(in + width * 3);
+      streamStore(out, a);
+      streamStore(out + width, b);
+      streamStore(out + width * 2, c);
+      streamStore(out + width * 3, d);
+      out += width * 4, in += width * 4;
+    }
+    for(; size >= width; size -= width) {
+      streamStore(out, streamLoad(in));
+      out += width, in += width;
+    }
+    streamFence();
+    std::memcpy(out, in, size);
+  }
+
+  NOINLINE inline void streamFillLarge(unsigned char* out,
+   unsigned char value, inl_szt_ size) NOEXCEPT {
+    constexpr inl_szt_ width = streamWidth;
+    const inl_szt_ head = streamHead(out);
+    std::memset(out, value, head);
+    out += head, size -= head;
+
+    const StreamVec v = streamSplat(value);
+    for(; size >= width * 4; size -= width * 4) {
+      streamStore(out, v);
+      streamStore(out + width, v);
+      streamStore(out + width * 2, v);
+      streamStore(out + width * 3, v);
+      out += width * 4;
+    }
+    for(; size >= width; size -= width) {
+      streamStore(out, v);
+      out += width;
+    }
+    streamFence();
+    std::memset(out, value, size);
+  }
+#endif
+} // namespace H
+
+/**
+ * Copies `size` bytes without pulling `dst` into the cache.
+ * Meant for large outputs that won't be read back soon
+ * (eg. flushing to a mapped segment). Falls back to `memcpy`
+ * below `H::streamThreshold()` or without vector support.
+ * Ends with a store fence, so the data is visible before later stores.
+ */
+inline void streamCopy(void* RESTRICT dst,
+ const void* RESTRICT src, H::inl_szt_ size) NOEXCEPT {
+#if EFLI_STREAM_WIDTH_ != 0
+  if(size >= H::streamThreshold() && size >= H::streamWidth * 2) {
+    H::streamCopyLarge(static_cast<unsigned char*>(dst),
+      static_cast<const unsigned char*>(src), size);
+    return;
+  }
+#endif
+  std::memcpy(dst, src, size);
+}
+
+/// Like `streamCopy`, but sets every byte to `value`.
+inline void streamFill(void* dst, unsigned char value,
+ H::inl_szt_ size) NOEXCEPT {
+#if EFLI_STREAM_WIDTH_ != 0
+  if(size >= H::streamThreshold() && size >= H::streamWidth * 2) {
+    H::streamFillLarge(static_cast<unsigned char*>(dst), value, size);
+    return;
+  }
+#endif
+  std::memset(dst, value, size);
+}
+
+} // namespace config
+} // namespace efl
+
+#undef EFLI_STREAM_WIDTH_
+#undef EFLI_STREAM_X86_
+#undef EFLI_STREAM_STNP_
+
+#endif // EFL_STREAM_HPP
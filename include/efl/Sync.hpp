@@ -0,0 +1,414 @@
+//===- efl/Sync.hpp -------------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides spin-waiting and synchronization primitives.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_SYNC_HPP
+#define EFL_SYNC_HPP
+
+#include <efl/Config.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_ANDROID)
+# include <linux/futex.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+# include <ctime>
+# include <mutex>
+# if __has_include(<linux/membarrier.h>)
+#  include <linux/membarrier.h>
+# endif
+# define EFLI_SYNC_FUTEX_ 1
+#elif defined(PLATFORM_WINDOWS)
+# include <windows.h>
+# if defined(COMPILER_MSVC)
+EFL_COMPILER_PRAGMA(comment(lib, "Synchronization.lib"))
+# endif
+# define EFLI_SYNC_WAIT_ADDRESS_ 1
+#endif
+
+#if defined(ARCH_AMD) || defined(ARCH_x86)
+# if defined(COMPILER_MSVC)
+#  include <intrin.h>
+# else
+#  include <immintrin.h>
+# endif
+#elif defined(ARCH_ARM64) && defined(COMPILER_MSVC)
+# include <intrin.h>
+#endif
+
+#ifndef EFL_SPIN_SHIFT_MAX
+/**
+ * Log2 of the most relax hints issued per `Backoff` step.
+ * `pause` takes ~140 cycles since Skylake, so x86 stays low.
+ */
+# if defined(ARCH_AMD) || defined(ARCH_x86)
+#  define EFL_SPIN_SHIFT_MAX 4
+# else
+#  define EFL_SPIN_SHIFT_MAX 6
+# endif
+#endif
+
+#ifndef EFL_SPIN_YIELD_AFTER
+/// Number of `Backoff` steps before yielding to the scheduler.
+# define EFL_SPIN_YIELD_AFTER (EFL_SPIN_SHIFT_MAX + 4)
+#endif
+
+namespace efl {
+namespace config {
+
+/// Hints to the CPU that the caller is in a spin-wait loop.
+ALWAYS_INLINE void cpuRelax() NOEXCEPT {
+#if defined(ARCH_AMD) || defined(ARCH_x86)
+  _mm_pause();
+#elif defined(ARCH_ARM64) && defined(COMPILER_MSVC)
+  __isb(_ARM64_BARRIER_SY);
+#elif defined(ARCH_ARM64)
+  // `isb` stalls for longer than `yield`, which is a nop on most cores.
+  __asm__ __volatile__("isb" ::: "memory");
+#elif defined(ARCH_ARM) && !defined(COMPILER_MSVC)
+  __asm__ __volatile__("yield" ::: "memory");
+#else
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+/// Exponential backoff for spin-waiting, falls back to yielding.
+class Backoff {
+public:
+  static constexpr unsigned shiftMax = EFL_SPIN_SHIFT_MAX;
+  static constexpr unsigned yieldAfter = EFL_SPIN_YIELD_AFTER;
+
+public:
+  /// Waits a bit longer than last time.
+  void pause() NOEXCEPT {
+    if(step_ < yieldAfter) {
+      const unsigned shift = (step_ < shiftMax) ? step_ : unsigned(shiftMax);
+      for(unsigned n = 0; n < (1u << shift); ++n)
+        cpuRelax();
+      ++step_;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+
+  /// Spins if there is budget left, returns `false` once it would yield.
+  bool tryPause() NOEXCEPT {
+    if(step_ >= yieldAfter)
+      return false;
+    this->pause();
+    return true;
+  }
+
+  bool isYielding() const NOEXCEPT { return step_ >= yieldAfter; }
+  void reset() NOEXCEPT { step_ = 0; }
+
+private:
+  unsigned step_ = 0;
+};
+
+/// A test-and-test-and-set lock, padded to its own cache line.
+class alignas(Arch::cacheLineSize) SpinLock {
+public:
+  SpinLock() = default;
+  SpinLock(const SpinLock&) = delete;
+  SpinLock& operator=(const SpinLock&) = delete;
+
+  void lock() NOEXCEPT {
+    Backoff backoff;
+    while(locked_.exchange(true, std::memory_order_acquire)) {
+      do {
+        backoff.pause();
+      } while(locked_.load(std::memory_order_relaxed));
+    }
+  }
+
+  NODISCARD bool try_lock() NOEXCEPT {
+    return !locked_.load(std::memory_order_relaxed) &&
+      !locked_.exchange(true, std::memory_order_acquire);
+  }
+
+  void unlock() NOEXCEPT
+  { locked_.store(false, std::memory_order_release); }
+
+  bool isLocked() const NOEXCEPT
+  { return locked_.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<bool> locked_ { false };
+};
+
+/// A FIFO ticket lock, padded to its own cache line.
+class alignas(Arch::cacheLineSize) TicketLock {
+public:
+  TicketLock() = default;
+  TicketLock(const TicketLock&) = delete;
+  TicketLock& operator=(const TicketLock&) = delete;
+
+  void lock() NOEXCEPT {
+    const std::uint32_t ticket =
+      next_.fetch_add(1, std::memory_order_relaxed);
+    Backoff backoff;
+    std::uint32_t curr = serving_.load(std::memory_order_acquire);
+    while(curr != ticket) {
+      // Yield early when far back in line, the holder may be preempted.
+      if(ticket - curr > Backoff::yieldAfter)
+        std::this_thread::yield();
+      else
+        backoff.pause();
+      curr = serving_.load(std::memory_order_acquire);
+    }
+  }
+
+  NODISCARD bool try_lock() NOEXCEPT {
+    std::uint32_t curr = serving_.load(std::memory_order_acquire);
+    return next_.compare_exchange_strong(curr, curr + 1,
+      std::memory_order_acquire, std::memory_order_relaxed);
+  }
+
+  void unlock() NOEXCEPT {
+    const std::uint32_t curr = serving_.load(std::memory_order_relaxed);
+    serving_.store(curr + 1, std::memory_order_release);
+  }
+
+  bool isLocked() const NOEXCEPT {
+    return next_.load(std::memory_order_relaxed) !=
+      serving_.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<std::uint32_t> next_ { 0 };
+  std::atomic<std::uint32_t> serving_ { 0 };
+};
+
+namespace H {
+  using WaitClock = std::chrono::steady_clock;
+
+  /// Parks until woken, or `timeout` passes. May wake spuriously.
+  inline void parkOnAddress(const std::atomic<std::uint32_t>* addr,
+   std::uint32_t old, std::chrono::nanoseconds timeout) NOEXCEPT {
+#if defined(EFLI_SYNC_FUTEX_)
+    struct timespec ts;
+    struct timespec* pts = nullptr;
+    if(timeout != std::chrono::nanoseconds::max()) {
+      const auto ns = timeout.count();
+      ts.tv_sec = static_cast<std::time_t>(ns / 1000000000);
+      ts.tv_nsec = static_cast<long>(ns % 1000000000);
+      pts = &ts;
+    }
+    ::syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, old, pts, nullptr, 0);
+#elif defined(EFLI_SYNC_WAIT_ADDRESS_)
+    DWORD ms = INFINITE;
+    if(timeout != std::chrono::nanoseconds::max()) {
+      const auto count = std::chrono::duration_cast<
+        std::chrono::milliseconds>(timeout).count();
+      ms = static_cast<DWORD>((count < INFINITE - 1) ? count + 1 : INFINITE - 1);
+    }
+    ::WaitOnAddress(const_cast<std::atomic<std::uint32_t>*>(addr),
+      &old, sizeof(old), ms);
+#else
+    // No kernel wait queue, poll with a short sleep.
+    (void) addr;
+    (void) old;
+    const std::chrono::nanoseconds nap = std::chrono::microseconds(50);
+    std::this_thread::sleep_for((timeout < nap) ? timeout : nap);
+#endif
+  }
+} // namespace H
+
+/**
+ * Blocks while `*addr == old`, spinning briefly before parking.
+ * Returns `false` if `timeout` passed with the value unchanged.
+ * Uses futexes on Linux and `WaitOnAddress` on Windows.
+ */
+inline bool atomicWait(const std::atomic<std::uint32_t>* addr,
+ std::uint32_t old, std::chrono::nanoseconds timeout
+  = std::chrono::nanoseconds::max()) NOEXCEPT {
+  Backoff backoff;
+  do {
+    if(addr->load(std::memory_order_acquire) != old)
+      return true;
+  } while(backoff.tryPause());
+
+  const bool forever = (timeout == std::chrono::nanoseconds::max());
+  const auto deadline = forever ? H::WaitClock::time_point::max() :
+    H::WaitClock::now() + timeout;
+  while(addr->load(std::memory_order_acquire) == old) {
+    auto remaining = std::chrono::nanoseconds::max();
+    if(!forever) {
+      const auto now = H::WaitClock::now();
+      if(now >= deadline)
+        return false;
+      remaining = deadline - now;
+    }
+    H::parkOnAddress(addr, old, remaining);
+  }
+  return true;
+}
+
+/// Wakes one thread blocked in `atomicWait` on `addr`.
+inline void atomicNotifyOne(const std::atomic<std::uint32_t>* addr) NOEXCEPT {
+#if defined(EFLI_SYNC_FUTEX_)
+  ::syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#elif defined(EFLI_SYNC_WAIT_ADDRESS_)
+  ::WakeByAddressSingle(const_cast<std::atomic<std::uint32_t>*>(addr));
+#else
+  (void) addr;
+#endif
+}
+
+/// Wakes every thread blocked in `atomicWait` on `addr`.
+inline void atomicNotifyAll(const std::atomic<std::uint32_t>* addr) NOEXCEPT {
+#if defined(EFLI_SYNC_FUTEX_)
+  ::syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#elif defined(EFLI_SYNC_WAIT_ADDRESS_)
+  ::WakeByAddressAll(const_cast<std::atomic<std::uint32_t>*>(addr));
+#else
+  (void) addr;
+#endif
+}
+
+namespace H {
+#if defined(EFLI_SYNC_FUTEX_)
+# if defined(ARCH_AMD) || defined(ARCH_x86)
+// Only x86 shoots down remote TLBs with IPIs, ARM broadcasts `tlbi`.
+#  define EFLI_SYNC_MPROTECT_ 1
+# endif
+
+  enum class HeavyFenceKind {
+    PRIVATE_EXPEDITED,  ///< `membarrier`, registered on first use.
+    SHARED,             ///< `membarrier`, waits for a grace period.
+    MPROTECT,           ///< Forces an IPI via a TLB shootdown (x86 only).
+    FULL,               ///< Nothing asymmetric, both sides fully fence.
+  };
+
+  /// What `heavyFence` falls back to without `membarrier`.
+  constexpr HeavyFenceKind heavyFenceFallback() NOEXCEPT {
+# if defined(EFLI_SYNC_MPROTECT_)
+    return HeavyFenceKind::MPROTECT;
+# else
+    return HeavyFenceKind::FULL;
+# endif
+  }
+
+  inline HeavyFenceKind heavyFenceKind() NOEXCEPT {
+    static const HeavyFenceKind kind = []() -> HeavyFenceKind {
+# if defined(SYS_membarrier) && defined(MEMBARRIER_CMD_QUERY)
+      const long mask = ::syscall(SYS_membarrier, MEMBARRIER_CMD_QUERY, 0);
+      if(mask < 0)
+        return heavyFenceFallback();
+#  if defined(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED)
+      if((mask & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+        ::syscall(SYS_membarrier,
+          MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0)
+        return HeavyFenceKind::PRIVATE_EXPEDITED;
+#  endif
+      if(mask & MEMBARRIER_CMD_SHARED)
+        return HeavyFenceKind::SHARED;
+# endif
+      return heavyFenceFallback();
+    }();
+    return kind;
+  }
+
+# if defined(EFLI_SYNC_MPROTECT_)
+  inline void mprotectFence() NOEXCEPT {
+    static std::mutex lock;
+    static void* const page = ::mmap(nullptr, Arch::pageSize,
+      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    std::lock_guard<std::mutex> guard(lock);
+    if(page == MAP_FAILED) {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      return;
+    }
+    // Dirtying then revoking the page flushes it from every core's TLB.
+    ::mprotect(page, Arch::pageSize, PROT_READ | PROT_WRITE);
+    *static_cast<volatile char*>(page) = 0;
+    ::mprotect(page, Arch::pageSize, PROT_READ);
+  }
+# endif // EFLI_SYNC_MPROTECT_
+#endif // EFLI_SYNC_FUTEX_
+} // namespace H
+
+/**
+ * The reader side of an asymmetric fence, only stops compiler reordering.
+ * Must be paired with `heavyFence` on the writer side.
+ * Where no heavy mechanism exists (including non-x86 Linux
+ * without `membarrier`) this is a full fence.
+ */
+ALWAYS_INLINE void lightFence() NOEXCEPT {
+#if defined(EFLI_SYNC_FUTEX_) && !defined(EFLI_SYNC_MPROTECT_)
+  if(H::heavyFenceKind() == H::HeavyFenceKind::FULL)
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#elif defined(EFLI_SYNC_FUTEX_) || defined(EFLI_SYNC_WAIT_ADDRESS_)
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+#else
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+}
+
+/**
+ * The writer side of an asymmetric fence, acts as a full fence
+ * on every thread of the process that ran `lightFence`.
+ * Uses `membarrier` on Linux and `FlushProcessWriteBuffers` on Windows.
+ */
+inline void heavyFence() NOEXCEPT {
+#if defined(EFLI_SYNC_FUTEX_)
+  switch(H::heavyFenceKind()) {
+# if defined(SYS_membarrier) && defined(MEMBARRIER_CMD_QUERY)
+#  if defined(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED)
+   case H::HeavyFenceKind::PRIVATE_EXPEDITED:
+    ::syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+    break;
+#  endif
+   case H::HeavyFenceKind::SHARED:
+    ::syscall(SYS_membarrier, MEMBARRIER_CMD_SHARED, 0);
+    break;
+# endif
+# if defined(EFLI_SYNC_MPROTECT_)
+   case H::HeavyFenceKind::MPROTECT:
+    H::mprotectFence();
+    break;
+# endif
+   default:
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    break;
+  }
+#elif defined(EFLI_SYNC_WAIT_ADDRESS_)
+  ::FlushProcessWriteBuffers();
+#else
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+}
+
+} // namespace config
+} // namespace efl
+
+#undef EFLI_SYNC_FUTEX_
+#undef EFLI_SYNC_WAIT_ADDRESS_
+#undef EFLI_SYNC_MPROTECT_
+
+#endif // EFL_SYNC_HPP
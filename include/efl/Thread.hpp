@@ -0,0 +1,306 @@
+//===- efl/Thread.hpp -----------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides per-thread state and thread utilities.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_THREAD_HPP
+#define EFL_THREAD_HPP
+
+#include <efl/PerCpu.hpp>
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+
+#if defined(PLATFORM_WINDOWS)
+# include <windows.h>
+#elif defined(PLATFORM_LINUX) || defined(PLATFORM_ANDROID)
+# include <pthread.h>
+# include <sched.h>
+# include <sys/prctl.h>
+# include <sys/resource.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#elif defined(PLATFORM_APPLE)
+# include <pthread.h>
+# include <sched.h>
+#endif
+
+#ifndef EFL_THREAD_SLOT_COUNT
+/// Number of slots in `ThreadSlots::Block`, including the discard slot.
+# define EFL_THREAD_SLOT_COUNT 64
+#endif
+
+namespace efl {
+namespace config {
+
+class ThreadSlot;
+
+/**
+ * Packs hot per-thread values into one cache-aligned block,
+ * so all of them are reached with a single initial-exec TLS access.
+ */
+class ThreadSlots {
+public:
+  using value_type = std::uint64_t;
+  static constexpr H::inl_szt_ count = EFL_THREAD_SLOT_COUNT;
+  /// Slot used by handles claimed after the block filled up.
+  static constexpr H::inl_szt_ discard = count - 1;
+
+  struct alignas(Arch::cacheLineSize) Block {
+    value_type slots[count];
+  };
+
+public:
+  /// The calling thread's block.
+  ALWAYS_INLINE static Block& local() NOEXCEPT {
+    EFL_TLS_INITIAL_EXEC static THREAD_LOCAL Block block;
+    return block;
+  }
+
+  /// Claims a slot shared by all threads, usually during static init.
+  static ThreadSlot claim() NOEXCEPT;
+
+  /// Number of slots claimed so far.
+  static H::inl_szt_ claimed() NOEXCEPT {
+    const H::inl_szt_ next = counter().load(std::memory_order_relaxed);
+    return (next < discard) ? next : H::inl_szt_(discard);
+  }
+
+private:
+  static std::atomic<H::inl_szt_>& counter() NOEXCEPT {
+    static std::atomic<H::inl_szt_> next { 0 };
+    return next;
+  }
+};
+
+/// A handle to one slot of `ThreadSlots::Block`.
+class ThreadSlot {
+  friend class ThreadSlots;
+  explicit constexpr ThreadSlot(H::inl_szt_ index) NOEXCEPT
+   : index_(index) { }
+
+public:
+  using value_type = ThreadSlots::value_type;
+
+  /// False if the registry was full, writes then go to the discard slot.
+  constexpr bool isValid() const NOEXCEPT
+  { return index_ != ThreadSlots::discard; }
+  constexpr H::inl_szt_ index() const NOEXCEPT { return index_; }
+
+  ALWAYS_INLINE value_type& get() const NOEXCEPT
+  { return ThreadSlots::local().slots[index_]; }
+  ALWAYS_INLINE void add(value_type n = 1) const NOEXCEPT
+  { this->get() += n; }
+  ALWAYS_INLINE void set(value_type n) const NOEXCEPT
+  { this->get() = n; }
+
+private:
+  H::inl_szt_ index_;
+};
+
+inline ThreadSlot ThreadSlots::claim() NOEXCEPT {
+  const H::inl_szt_ index =
+    counter().fetch_add(1, std::memory_order_relaxed);
+  return ThreadSlot((index < discard) ? index : H::inl_szt_(discard));
+}
+
+namespace thread {
+
+/// Logical CPU ids, sized like glibc's `cpu_set_t`.
+using CpuSet = std::bitset<1024>;
+
+enum class Priority {
+  LOWEST,
+  LOW,
+  NORMAL,
+  HIGH,
+  HIGHEST,
+};
+
+/**
+ * Restricts the calling thread to the CPUs in `cpus`.
+ * On Windows, only the processor group of the first CPU is used.
+ * Returns false if unsupported (eg. Haiku, Solaris, macOS) or denied.
+ */
+inline bool setAffinity(const CpuSet& cpus) NOEXCEPT {
+  if(cpus.none())
+    return false;
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_ANDROID)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for(H::inl_szt_ cpu = 0; cpu < cpus.size() && cpu < CPU_SETSIZE; ++cpu) {
+    if(cpus[cpu])
+      CPU_SET(cpu, &set);
+  }
+# if defined(PLATFORM_ANDROID)
+  return ::sched_setaffinity(0, sizeof(set), &set) == 0;
+# else
+  return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+# endif
+#elif defined(PLATFORM_WINDOWS)
+  H::inl_szt_ first = 0;
+  while(!cpus[first])
+    ++first;
+  const WORD group = WORD(first / 64);
+  KAFFINITY mask = 0;
+  for(H::inl_szt_ bit = 0; bit < 64; ++bit) {
+    const H::inl_szt_ cpu = H::inl_szt_(group) * 64 + bit;
+    if(cpu < cpus.size() && cpus[cpu])
+      mask |= KAFFINITY(1) << bit;
+  }
+  if(group == 0)
+    return ::SetThreadAffinityMask(::GetCurrentThread(), mask) != 0;
+  GROUP_AFFINITY affinity = {};
+  affinity.Mask = mask;
+  affinity.Group = group;
+  return ::SetThreadGroupAffinity(
+    ::GetCurrentThread(), &affinity, nullptr) != 0;
+#else
+  return false;
+#endif
+}
+
+/// Pins the calling thread to a single CPU.
+inline bool setAffinity(unsigned cpu) NOEXCEPT {
+  CpuSet cpus;
+  if(cpu >= cpus.size())
+    return false;
+  cpus.set(cpu);
+  return setAffinity(cpus);
+}
+
+/**
+ * The CPUs the calling thread may run on, which reflects `taskset`,
+ * cgroup cpusets and container limits. On Windows, the process mask
+ * for the calling thread's processor group.
+ * Returns false if unknown, `cpus` is then left empty.
+ */
+inline bool getAffinity(CpuSet& cpus) NOEXCEPT {
+  cpus.reset();
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_ANDROID)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if(::sched_getaffinity(0, sizeof(set), &set) != 0)
+    return false;
+  for(H::inl_szt_ cpu = 0; cpu < cpus.size() && cpu < CPU_SETSIZE; ++cpu) {
+    if(CPU_ISSET(cpu, &set))
+      cpus.set(cpu);
+  }
+  return cpus.any();
+#elif defined(PLATFORM_WINDOWS)
+  DWORD_PTR process = 0, system = 0;
+  // Both masks are 0 when the process spans several groups.
+  if(!::GetProcessAffinityMask(::GetCurrentProcess(), &process, &system) ||
+    process == 0)
+    return false;
+  GROUP_AFFINITY current = {};
+  if(!::GetThreadGroupAffinity(::GetCurrentThread(), &current))
+    return false;
+  for(H::inl_szt_ bit = 0; bit < 64; ++bit) {
+    const H::inl_szt_ cpu = H::inl_szt_(current.Group) * 64 + bit;
+    if(cpu < cpus.size() && ((process >> bit) & 1))
+      cpus.set(cpu);
+  }
+  return cpus.any();
+#else
+  return false;
+#endif
+}
+
+/**
+ * Names the calling thread for debuggers and profilers.
+ * Linux truncates names to 15 characters.
+ */
+inline bool setName(const char* name) NOEXCEPT {
+  if(!name)
+    return false;
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_ANDROID)
+  return ::prctl(PR_SET_NAME, name, 0, 0, 0) == 0;
+#elif defined(PLATFORM_APPLE)
+  return ::pthread_setname_np(name) == 0;
+#elif defined(PLATFORM_WINDOWS)
+  // Looked up at runtime, it only exists on Windows 10 1607+.
+  using SetDescription = HRESULT(WINAPI*)(HANDLE, PCWSTR);
+  const HMODULE kernel = ::GetModuleHandleW(L"kernel32.dll");
+  const auto set = kernel ? reinterpret_cast<SetDescription>(
+    reinterpret_cast<void*>(::GetProcAddress(kernel, "SetThreadDescription")))
+    : nullptr;
+  if(!set)
+    return false;
+  wchar_t wide[256];
+  if(::MultiByteToWideChar(CP_UTF8, 0, name, -1, wide, 256) == 0)
+    return false;
+  return SUCCEEDED(set(::GetCurrentThread(), wide));
+#else
+  return false;
+#endif
+}
+
+/**
+ * Adjusts the scheduling priority of the calling thread.
+ * Raising it usually needs privileges, returns false when denied.
+ */
+inline bool setPriority(Priority priority) NOEXCEPT {
+  const int level = static_cast<int>(priority);
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_ANDROID)
+  // Linux threads have their own nice value, keyed on the tid.
+  static constexpr int niceness[] = { 19, 10, 0, -5, -10 };
+  const auto tid = static_cast<id_t>(::syscall(SYS_gettid));
+  return ::setpriority(PRIO_PROCESS, tid, niceness[level]) == 0;
+#elif defined(PLATFORM_WINDOWS)
+  static constexpr int levels[] = {
+    THREAD_PRIORITY_LOWEST, THREAD_PRIORITY_BELOW_NORMAL,
+    THREAD_PRIORITY_NORMAL, THREAD_PRIORITY_ABOVE_NORMAL,
+    THREAD_PRIORITY_HIGHEST };
+  return ::SetThreadPriority(::GetCurrentThread(), levels[level]) != 0;
+#elif defined(PLATFORM_APPLE)
+  int policy;
+  sched_param param;
+  if(::pthread_getschedparam(::pthread_self(), &policy, &param) != 0)
+    return false;
+  const int low = ::sched_get_priority_min(policy);
+  const int high = ::sched_get_priority_max(policy);
+  param.sched_priority = low + (high - low) * level / 4;
+  return ::pthread_setschedparam(::pthread_self(), policy, &param) == 0;
+#else
+  (void) level;
+  return false;
+#endif
+}
+
+/// The CPU the calling thread is running on, or -1 if unknown.
+inline int currentCpu() NOEXCEPT {
+#if defined(PLATFORM_WINDOWS)
+  PROCESSOR_NUMBER number;
+  ::GetCurrentProcessorNumberEx(&number);
+  return int(number.Group) * 64 + int(number.Number);
+#else
+  if(H::cpuSource() == H::CpuSource::THREAD_HASH)
+    return -1;
+  return static_cast<int>(H::currentCpu());
+#endif
+}
+
+} // namespace thread
+
+} // namespace config
+} // namespace efl
+
+#endif // EFL_THREAD_HPP
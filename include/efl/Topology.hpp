@@ -0,0 +1,494 @@
+//===- efl/Topology.hpp ---------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides runtime CPU topology and cache discovery.
+//  Use `Arch` for the compile-time guesses.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_TOPOLOGY_HPP
+#define EFL_TOPOLOGY_HPP
+
+#include <efl/Config.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(PLATFORM_WINDOWS)
+# include <windows.h>
+#elif defined(PLATFORM_APPLE)
+# include <sys/sysctl.h>
+#endif
+
+#if !defined(PLATFORM_LINUX) && !defined(PLATFORM_ANDROID) && \
+  !defined(PLATFORM_WINDOWS) && (defined(ARCH_AMD) || defined(ARCH_x86))
+# if defined(COMPILER_MSVC)
+#  include <intrin.h>
+# else
+#  include <cpuid.h>
+# endif
+# define EFLI_TOPOLOGY_CPUID_ 1
+#endif
+
+namespace efl {
+namespace config {
+
+enum class CacheType {
+  UNIFIED,
+  DATA,
+  INSTRUCTION,
+};
+
+struct CacheInfo {
+  unsigned level;
+  CacheType type;
+  H::inl_szt_ size;
+  H::inl_szt_ lineSize;
+  /// Logical CPUs sharing this cache, may be empty if unknown.
+  std::vector<unsigned> sharedCpus;
+};
+
+struct CpuInfo {
+  unsigned id;
+  unsigned core;
+  unsigned package;
+  unsigned node;
+};
+
+namespace H {
+  inline bool readText(const std::string& path, std::string& out) {
+    std::FILE* const file = std::fopen(path.c_str(), "r");
+    if(!file)
+      return false;
+    out.clear();
+    char buf[256];
+    inl_szt_ n;
+    while((n = std::fread(buf, 1, sizeof(buf), file)) != 0)
+      out.append(buf, n);
+    std::fclose(file);
+    while(!out.empty() && (out.back() == '\n' || out.back() == ' '))
+      out.pop_back();
+    return true;
+  }
+
+  inline bool readNumber(const std::string& path, unsigned long& out) {
+    std::string text;
+    if(!readText(path, text) || text.empty())
+      return false;
+    out = std::strtoul(text.c_str(), nullptr, 10);
+    return true;
+  }
+
+  /// Parses kernel cpu lists, eg. "0-3,8,10-11".
+  inline std::vector<unsigned> parseCpuList(const std::string& text) {
+    std::vector<unsigned> out;
+    const char* curr = text.c_str();
+    while(*curr) {
+      char* end = nullptr;
+      const unsigned long first = std::strtoul(curr, &end, 10);
+      if(end == curr)
+        break;
+      unsigned long last = first;
+      curr = end;
+      if(*curr == '-') {
+        last = std::strtoul(curr + 1, &end, 10);
+        curr = end;
+      }
+      for(unsigned long cpu = first; cpu <= last; ++cpu)
+        out.push_back(unsigned(cpu));
+      while(*curr == ',' || *curr == ' ' || *curr == '\n')
+        ++curr;
+    }
+    return out;
+  }
+
+  /// Parses sizes like "32K" or "1M".
+  inline inl_szt_ parseSize(const std::string& text) {
+    char* end = nullptr;
+    inl_szt_ size = std::strtoul(text.c_str(), &end, 10);
+    if(end && (*end == 'K' || *end == 'k'))
+      size <<= 10;
+    else if(end && (*end == 'M' || *end == 'm'))
+      size <<= 20;
+    else if(end && (*end == 'G' || *end == 'g'))
+      size <<= 30;
+    return size;
+  }
+} // namespace H
+
+/**
+ * The host's logical CPUs, NUMA nodes and cache hierarchy.
+ * `query()` detects it once and caches the result.
+ */
+class Topology {
+public:
+  /// The topology of the running host, detected on first call.
+  static const Topology& query() {
+    static const Topology topology = Topology::detect();
+    return topology;
+  }
+
+  /**
+   * Reads a Linux style sysfs tree mounted at `root`, from
+   * `devices/system/cpu/` and optionally `devices/system/node/`.
+   * Useful for testing against fake trees.
+   */
+  static Topology fromSysfs(const std::string& root = "/sys") {
+    const std::string system = root + "/devices/system";
+    Topology out;
+    std::string text;
+    // Without a cpu list (eg. /sys masked), `finish` falls back to
+    // `hardware_concurrency`.
+    if(H::readText(system + "/cpu/online", text) ||
+      H::readText(system + "/cpu/possible", text)) {
+      for(unsigned cpu : H::parseCpuList(text))
+        out.cpus_.push_back(CpuInfo { cpu, cpu, 0, 0 });
+    }
+
+    for(CpuInfo& info : out.cpus_) {
+      const std::string dir = system + "/cpu/cpu" + std::to_string(info.id);
+      unsigned long value;
+      if(H::readNumber(dir + "/topology/core_id", value))
+        info.core = unsigned(value);
+      if(H::readNumber(dir + "/topology/physical_package_id", value))
+        info.package = unsigned(value);
+      for(unsigned index = 0; ; ++index) {
+        const std::string cache =
+          dir + "/cache/index" + std::to_string(index);
+        if(!H::readNumber(cache + "/level", value))
+          break;
+        CacheInfo entry { unsigned(value), CacheType::UNIFIED, 0, 0, {} };
+        if(H::readText(cache + "/type", text)) {
+          if(text == "Data")
+            entry.type = CacheType::DATA;
+          else if(text == "Instruction")
+            entry.type = CacheType::INSTRUCTION;
+        }
+        if(H::readText(cache + "/size", text))
+          entry.size = H::parseSize(text);
+        if(H::readNumber(cache + "/coherency_line_size", value))
+          entry.lineSize = H::inl_szt_(value);
+        if(H::readText(cache + "/shared_cpu_list", text))
+          entry.sharedCpus = H::parseCpuList(text);
+        out.addCache(std::move(entry));
+      }
+    }
+
+    // Nodes are optional, everything stays on node 0 without them.
+    if(H::readText(system + "/node/online", text)) {
+      for(unsigned node : H::parseCpuList(text)) {
+        std::string list;
+        if(!H::readText(system + "/node/node" +
+          std::to_string(node) + "/cpulist", list))
+          continue;
+        for(unsigned cpu : H::parseCpuList(list)) {
+          if(CpuInfo* info = out.findCpu(cpu))
+            info->node = node;
+        }
+      }
+    }
+    out.finish();
+    return out;
+  }
+
+public:
+  const std::vector<CpuInfo>& cpus() const NOEXCEPT { return cpus_; }
+  const std::vector<CacheInfo>& caches() const NOEXCEPT { return caches_; }
+
+  unsigned cpuCount() const NOEXCEPT { return unsigned(cpus_.size()); }
+  unsigned coreCount() const NOEXCEPT { return cores_; }
+  unsigned packageCount() const NOEXCEPT { return packages_; }
+  unsigned nodeCount() const NOEXCEPT { return nodes_; }
+  /// Hardware threads per core.
+  unsigned smtWidth() const NOEXCEPT
+  { return cores_ ? unsigned(cpus_.size()) / cores_ : 1; }
+
+  /// The data (or unified) cache at `level`, or `nullptr`.
+  const CacheInfo* dataCache(unsigned level) const NOEXCEPT {
+    for(const CacheInfo& cache : caches_) {
+      if(cache.level == level && cache.type != CacheType::INSTRUCTION)
+        return &cache;
+    }
+    return nullptr;
+  }
+
+  /// Size of the data cache at `level`, falls back to 0.
+  H::inl_szt_ cacheSize(unsigned level) const NOEXCEPT {
+    const CacheInfo* cache = this->dataCache(level);
+    return cache ? cache->size : 0;
+  }
+
+  /// Coherency line size of the L1 data cache, or `Arch::cacheLineSize`.
+  H::inl_szt_ cacheLineSize() const NOEXCEPT {
+    const CacheInfo* cache = this->dataCache(1);
+    return (cache && cache->lineSize) ?
+      cache->lineSize : H::inl_szt_(Arch::cacheLineSize);
+  }
+
+  /// Logical CPUs on `node`.
+  std::vector<unsigned> nodeCpus(unsigned node) const {
+    std::vector<unsigned> out;
+    for(const CpuInfo& cpu : cpus_) {
+      if(cpu.node == node)
+        out.push_back(cpu.id);
+    }
+    return out;
+  }
+
+  const CpuInfo* findCpu(unsigned id) const NOEXCEPT {
+    for(const CpuInfo& cpu : cpus_) {
+      if(cpu.id == id)
+        return &cpu;
+    }
+    return nullptr;
+  }
+
+private:
+  Topology() = default;
+
+  CpuInfo* findCpu(unsigned id) NOEXCEPT {
+    return const_cast<CpuInfo*>(
+      static_cast<const Topology*>(this)->findCpu(id));
+  }
+
+  /// Adds `cache` unless an identical one was already seen.
+  void addCache(CacheInfo&& cache) {
+    for(const CacheInfo& seen : caches_) {
+      if(seen.level == cache.level && seen.type == cache.type &&
+        seen.sharedCpus == cache.sharedCpus)
+        return;
+    }
+    caches_.push_back(std::move(cache));
+  }
+
+  /// Counts distinct cores/packages/nodes and fills in gaps.
+  void finish() {
+    if(cpus_.empty()) {
+      const unsigned count = std::thread::hardware_concurrency();
+      for(unsigned cpu = 0; cpu < (count ? count : 1); ++cpu)
+        cpus_.push_back(CpuInfo { cpu, cpu, 0, 0 });
+    }
+    std::vector<std::pair<unsigned, unsigned>> cores;
+    std::vector<unsigned> packages, nodes;
+    for(const CpuInfo& cpu : cpus_) {
+      cores.emplace_back(cpu.package, cpu.core);
+      packages.push_back(cpu.package);
+      nodes.push_back(cpu.node);
+    }
+    cores_ = countUnique(cores);
+    packages_ = countUnique(packages);
+    nodes_ = countUnique(nodes);
+    std::stable_sort(caches_.begin(), caches_.end(),
+      [](const CacheInfo& l, const CacheInfo& r) {
+        return l.level < r.level;
+      });
+  }
+
+  template <typename T>
+  static unsigned countUnique(std::vector<T>& values) {
+    std::sort(values.begin(), values.end());
+    return unsigned(std::unique(values.begin(), values.end()) - values.begin());
+  }
+
+#if defined(EFLI_TOPOLOGY_CPUID_)
+  static void cpuid(unsigned leaf, unsigned sub, unsigned (&regs)[4]) {
+# if defined(COMPILER_MSVC)
+    int out[4];
+    __cpuidex(out, int(leaf), int(sub));
+    for(int i = 0; i < 4; ++i)
+      regs[i] = unsigned(out[i]);
+# else
+    __cpuid_count(leaf, sub, regs[0], regs[1], regs[2], regs[3]);
+# endif
+  }
+
+  /// Reads caches from cpuid leaf 4 (or 0x8000001D on AMD).
+  void detectCpuid() {
+    unsigned regs[4];
+    cpuid(0, 0, regs);
+    const bool isAmd = (regs[1] == 0x68747541); // "Auth"
+    unsigned leaf = 4;
+    if(isAmd) {
+      cpuid(0x80000000, 0, regs);
+      if(regs[0] < 0x8000001D)
+        return;
+      leaf = 0x8000001D;
+    } else if(regs[0] < 4) {
+      return;
+    }
+    for(unsigned sub = 0; sub < 16; ++sub) {
+      cpuid(leaf, sub, regs);
+      const unsigned kind = regs[0] & 0x1F;
+      if(kind == 0)
+        break;
+      CacheInfo cache { (regs[0] >> 5) & 0x7, CacheType::UNIFIED, 0, 0, {} };
+      if(kind == 1)
+        cache.type = CacheType::DATA;
+      else if(kind == 2)
+        cache.type = CacheType::INSTRUCTION;
+      const H::inl_szt_ ways = ((regs[1] >> 22) & 0x3FF) + 1;
+      const H::inl_szt_ parts = ((regs[1] >> 12) & 0x3FF) + 1;
+      const H::inl_szt_ line = (regs[1] & 0xFFF) + 1;
+      const H::inl_szt_ sets = H::inl_szt_(regs[2]) + 1;
+      cache.size = ways * parts * line * sets;
+      cache.lineSize = line;
+      caches_.push_back(std::move(cache));
+    }
+  }
+#endif // EFLI_TOPOLOGY_CPUID_
+
+#if defined(PLATFORM_WINDOWS)
+  static void addMask(std::vector<unsigned>& out, const GROUP_AFFINITY& mask) {
+    for(unsigned bit = 0; bit < sizeof(KAFFINITY) * 8; ++bit) {
+      if(mask.Mask & (KAFFINITY(1) << bit))
+        out.push_back(unsigned(mask.Group) * 64 + bit);
+    }
+  }
+
+  void detectWindows() {
+    DWORD length = 0;
+    ::GetLogicalProcessorInformationEx(RelationAll, nullptr, &length);
+    std::vector<char> buffer(length);
+    auto* const first = reinterpret_cast<
+      SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data());
+    if(length == 0 ||
+      !::GetLogicalProcessorInformationEx(RelationAll, first, &length))
+      return;
+
+    unsigned core = 0, package = 0;
+    std::vector<std::pair<unsigned, unsigned>> packageOf, nodeOf;
+    for(DWORD off = 0; off < length; ) {
+      const auto* info = reinterpret_cast<
+        const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + off);
+      std::vector<unsigned> members;
+      switch(info->Relationship) {
+       case RelationProcessorCore:
+        for(WORD g = 0; g < info->Processor.GroupCount; ++g)
+          addMask(members, info->Processor.GroupMask[g]);
+        for(unsigned cpu : members)
+          cpus_.push_back(CpuInfo { cpu, core, 0, 0 });
+        ++core;
+        break;
+       case RelationProcessorPackage:
+        for(WORD g = 0; g < info->Processor.GroupCount; ++g)
+          addMask(members, info->Processor.GroupMask[g]);
+        for(unsigned cpu : members)
+          packageOf.emplace_back(cpu, package);
+        ++package;
+        break;
+       case RelationNumaNode:
+        addMask(members, info->NumaNode.GroupMask);
+        for(unsigned cpu : members)
+          nodeOf.emplace_back(cpu, unsigned(info->NumaNode.NodeNumber));
+        break;
+       case RelationCache: {
+        const CACHE_RELATIONSHIP& rel = info->Cache;
+        CacheInfo cache { unsigned(rel.Level), CacheType::UNIFIED,
+          H::inl_szt_(rel.CacheSize), H::inl_szt_(rel.LineSize), {} };
+        if(rel.Type == CacheData)
+          cache.type = CacheType::DATA;
+        else if(rel.Type == CacheInstruction)
+          cache.type = CacheType::INSTRUCTION;
+        else if(rel.Type == CacheTrace)
+          break;
+        addMask(cache.sharedCpus, rel.GroupMask);
+        this->addCache(std::move(cache));
+        break;
+       }
+       default:
+        break;
+      }
+      off += info->Size;
+    }
+    for(const auto& entry : packageOf) {
+      if(CpuInfo* cpu = this->findCpu(entry.first))
+        cpu->package = entry.second;
+    }
+    for(const auto& entry : nodeOf) {
+      if(CpuInfo* cpu = this->findCpu(entry.first))
+        cpu->node = entry.second;
+    }
+  }
+#endif // PLATFORM_WINDOWS
+
+#if defined(PLATFORM_APPLE)
+  static H::inl_szt_ sysctlValue(const char* name) {
+    std::int64_t value = 0;
+    size_t size = sizeof(value);
+    if(::sysctlbyname(name, &value, &size, nullptr, 0) != 0)
+      return 0;
+    return H::inl_szt_(value);
+  }
+
+  void detectApple() {
+    const H::inl_szt_ line = sysctlValue("hw.cachelinesize");
+    const char* const names[] = {
+      "hw.l1dcachesize", "hw.l2cachesize", "hw.l3cachesize" };
+    for(unsigned level = 1; level <= 3; ++level) {
+      const H::inl_szt_ size = sysctlValue(names[level - 1]);
+      if(size != 0) {
+        caches_.push_back(CacheInfo { level,
+          (level == 1) ? CacheType::DATA : CacheType::UNIFIED,
+          size, line, {} });
+      }
+    }
+    const H::inl_szt_ logical = sysctlValue("hw.logicalcpu");
+    const H::inl_szt_ physical = sysctlValue("hw.physicalcpu");
+    const H::inl_szt_ smt = (physical && logical > physical) ?
+      logical / physical : 1;
+    for(unsigned cpu = 0; cpu < logical; ++cpu)
+      cpus_.push_back(CpuInfo { cpu, unsigned(cpu / smt), 0, 0 });
+  }
+#endif // PLATFORM_APPLE
+
+  static Topology detect() {
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_ANDROID)
+    return Topology::fromSysfs();
+#else
+    Topology out;
+# if defined(PLATFORM_WINDOWS)
+    out.detectWindows();
+# elif defined(PLATFORM_APPLE)
+    out.detectApple();
+# elif defined(EFLI_TOPOLOGY_CPUID_)
+    out.detectCpuid();
+# endif
+    out.finish();
+    return out;
+#endif
+  }
+
+private:
+  std::vector<CpuInfo> cpus_;
+  std::vector<CacheInfo> caches_;
+  unsigned cores_ = 0;
+  unsigned packages_ = 0;
+  unsigned nodes_ = 0;
+};
+
+} // namespace config
+} // namespace efl
+
+#undef EFLI_TOPOLOGY_CPUID_
+
+#endif // EFL_TOPOLOGY_HPP
@@ -51,6 +51,8 @@
 #undef COMPILER_CURR
 #undef COMPILER_DEBUG
 #undef COMPILER_ELLCC
+#undef COMPILER_FAST_MATH
+#undef COMPILER_FP_CONTRACT
 #undef COMPILER_FUNCTION
 #undef COMPILER_FUNCTION_CLASSIC
 #undef COMPILER_GCC
@@ -76,10 +78,45 @@
 #undef DEBUG_ASSERT
 #undef DEBUG_ONLY
 #undef DEPRECATED
+#undef EFL_ALLOC_ALIGN
+#undef EFL_ALLOC_SIZE
 #undef EFL_ARCH_BITS
+#undef EFL_ARCH_CACHE_LINE_SIZE
+#undef EFL_ARCH_CONSTRUCTIVE_INTERFERENCE
+#undef EFL_ARCH_DESTRUCTIVE_INTERFERENCE
+#undef EFL_ARCH_HAS_AVX2
+#undef EFL_ARCH_HAS_AVX512BW
+#undef EFL_ARCH_HAS_AVX512F
+#undef EFL_ARCH_HAS_CRC32
+#undef EFL_ARCH_HAS_DWCAS
+#undef EFL_ARCH_HAS_LSE
+#undef EFL_ARCH_HAS_NEON
+#undef EFL_ARCH_HAS_PCLMUL
+#undef EFL_ARCH_HAS_PMULL
+#undef EFL_ARCH_HAS_SSE2
+#undef EFL_ARCH_HAS_SSE42
+#undef EFL_ARCH_HUGE_PAGE_SIZE
+#undef EFL_ARCH_MAX_LOCK_FREE_WIDTH
+#undef EFL_ARCH_PAGE_SIZE
 #undef EFL_ARCH_REGMAX
+#undef EFL_ARCH_SIMD_WIDTH
+#undef EFL_HAS_COMPUTED_GOTO
+#undef EFL_HAS_LABELS_AS_VALUES
+#undef EFL_HAS_MUSTTAIL
+#undef EFL_HAS_PRESERVE_ALL
+#undef EFL_HAS_PRESERVE_MOST
+#undef EFL_HAS_REGCALL
+#undef EFL_HAS_VECCALL
+#undef EFL_HAS_VECTOR_EXT
+#undef EFL_MICROARCH_NAME
+#undef EFL_MUSTTAIL
+#undef EFL_PRESERVE_ALL
+#undef EFL_PRESERVE_MOST
+#undef EFL_REGCALL
 #undef EFL_REGION_BEGIN
 #undef EFL_REGION_CLOSE
+#undef EFL_TLS_INITIAL_EXEC
+#undef EFL_TLS_LOCAL_EXEC
 #undef FALLTHROUGH
 #undef FASTCALL
 #undef FDEPRECATED
@@ -98,6 +135,15 @@
 #undef LLVM_POP
 #undef LLVM_WARNING
 #undef MAYBE_UNUSED
+#undef MICROARCH_ARMV8
+#undef MICROARCH_ARMV9
+#undef MICROARCH_CURR
+#undef MICROARCH_GENERIC
+#undef MICROARCH_TYPE
+#undef MICROARCH_X86_V1
+#undef MICROARCH_X86_V2
+#undef MICROARCH_X86_V3
+#undef MICROARCH_X86_V4
 #undef NODISCARD
 #undef NOEXCEPT
 #undef NOINLINE
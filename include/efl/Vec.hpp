@@ -0,0 +1,367 @@
+//===- efl/Vec.hpp --------------------------------------------------===//
+//
+// Copyright (C) 2023 Eightfold
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+//     limitations under the License.
+//
+//===----------------------------------------------------------------===//
+//
+//  This file provides a portable fixed-width SIMD vector.
+//  Built on GCC/Clang vector extensions (`EFL_HAS_VECTOR_EXT`),
+//  with a plain array fallback for other compilers.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef EFL_VEC_HPP
+#define EFL_VEC_HPP
+
+#include <efl/Config.hpp>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace efl {
+namespace config {
+namespace H {
+  template <inl_szt_ Size> struct MaskLane;
+  template <> struct MaskLane<1> { using type = std::int8_t; };
+  template <> struct MaskLane<2> { using type = std::int16_t; };
+  template <> struct MaskLane<4> { using type = std::int32_t; };
+  template <> struct MaskLane<8> { using type = std::int64_t; };
+
+  /// Lanes of `T` filling a native register, at least 16 bytes worth.
+  template <typename T>
+  constexpr inl_szt_ nativeLanes() NOEXCEPT {
+    return ((Arch::simdWidth > 16) ? Arch::simdWidth : 16) / sizeof(T);
+  }
+} // namespace H
+
+template <typename T, H::inl_szt_ N = H::nativeLanes<T>()>
+class Vec;
+
+/// Lanes are all ones (true) or all zeros (false).
+template <typename T, H::inl_szt_ N>
+using VecMask = Vec<typename H::MaskLane<sizeof(T)>::type, N>;
+
+/**
+ * `N` lanes of `T`, operated on together. Operators are lane-wise,
+ * comparisons return a `VecMask`. Prefer `Vec<T>`, which picks
+ * `N` from the widest registers enabled at compile time.
+ */
+template <typename T, H::inl_szt_ N>
+class Vec {
+  static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+    "`T` must be an arithmetic type.");
+  static_assert(N != 0 && (N & (N - 1)) == 0,
+    "`N` must be a power of two.");
+
+  template <typename, H::inl_szt_> friend class Vec;
+  using MaskT = typename H::MaskLane<sizeof(T)>::type;
+  using Mask = Vec<MaskT, N>;
+
+public:
+#if EFL_HAS_VECTOR_EXT
+  typedef T Native __attribute__((vector_size(N * sizeof(T))));
+#else
+  struct Native { T lanes[N]; };
+#endif
+  using value_type = T;
+  static constexpr H::inl_szt_ lanes = N;
+  static constexpr H::inl_szt_ size = N * sizeof(T);
+
+public:
+  Vec() = default;
+  explicit Vec(Native v) NOEXCEPT : v_(v) { }
+
+  /// Every lane set to `value`.
+  static Vec splat(T value) NOEXCEPT {
+    Vec out;
+    for(H::inl_szt_ i = 0; i < N; ++i)
+      out.set(i, value);
+    return out;
+  }
+
+  static Vec zero() NOEXCEPT { return splat(T(0)); }
+
+  static Vec load(const T* src) NOEXCEPT {
+    Vec out;
+    std::memcpy(&out.v_, src, size);
+    return out;
+  }
+
+  /// `src` must be aligned to `size`.
+  static Vec loadAligned(const T* src) NOEXCEPT {
+    Vec out;
+#if defined(__GNUC__)
+    src = static_cast<const T*>(__builtin_assume_aligned(src, size));
+#endif
+    std::memcpy(&out.v_, src, size);
+    return out;
+  }
+
+  void store(T* dst) const NOEXCEPT { std::memcpy(dst, &v_, size); }
+
+  /// `dst` must be aligned to `size`.
+  void storeAligned(T* dst) const NOEXCEPT {
+#if defined(__GNUC__)
+    dst = static_cast<T*>(__builtin_assume_aligned(dst, size));
+#endif
+    std::memcpy(dst, &v_, size);
+  }
+
+  T operator[](H::inl_szt_ i) const NOEXCEPT { return this->at(i); }
+
+  T at(H::inl_szt_ i) const NOEXCEPT {
+#if EFL_HAS_VECTOR_EXT
+    return v_[i];
+#else
+    return v_.lanes[i];
+#endif
+  }
+
+  void set(H::inl_szt_ i, T value) NOEXCEPT {
+#if EFL_HAS_VECTOR_EXT
+    v_[i] = value;
+#else
+    v_.lanes[i] = value;
+#endif
+  }
+
+  Native native() const NOEXCEPT { return v_; }
+
+  //=== Arithmetic ===//
+
+#if EFL_HAS_VECTOR_EXT
+# define EFLI_VEC_BINARY_(op) \
+  friend Vec operator op(Vec a, Vec b) NOEXCEPT \
+  { return Vec(a.v_ op b.v_); } \
+  Vec& operator op##=(Vec b) NOEXCEPT \
+  { v_ = v_ op b.v_; return *this; }
+#else
+# define EFLI_VEC_BINARY_(op) \
+  friend Vec operator op(Vec a, Vec b) NOEXCEPT { \
+    for(H::inl_szt_ i = 0; i < N; ++i) \
+      a.v_.lanes[i] = T(a.v_.lanes[i] op b.v_.lanes[i]); \
+    return a; \
+  } \
+  Vec& operator op##=(Vec b) NOEXCEPT \
+  { return *this = (*this op b); }
+#endif
+
+  EFLI_VEC_BINARY_(+)
+  EFLI_VEC_BINARY_(-)
+  EFLI_VEC_BINARY_(*)
+  EFLI_VEC_BINARY_(/)
+
+  Vec operator-() const NOEXCEPT { return Vec::zero() - *this; }
+
+  //=== Bitwise, integral only ===//
+
+  template <typename U = T, typename = typename
+    std::enable_if<std::is_integral<U>::value>::type>
+  friend Vec operator&(Vec a, Vec b) NOEXCEPT { return a.bitwise(b, 0); }
+  template <typename U = T, typename = typename
+    std::enable_if<std::is_integral<U>::value>::type>
+  friend Vec operator|(Vec a, Vec b) NOEXCEPT { return a.bitwise(b, 1); }
+  template <typename U = T, typename = typename
+    std::enable_if<std::is_integral<U>::value>::type>
+  friend Vec operator^(Vec a, Vec b) NOEXCEPT { return a.bitwise(b, 2); }
+
+  template <typename U = T, typename = typename
+    std::enable_if<std::is_integral<U>::value>::type>
+  Vec operator~() const NOEXCEPT { return *this ^ Vec::splat(T(~T(0))); }
+
+  template <typename U = T, typename = typename
+    std::enable_if<std::is_integral<U>::value>::type>
+  Vec operator<<(int shift) const NOEXCEPT {
+#if EFL_HAS_VECTOR_EXT
+    return Vec(v_ << shift);
+#else
+    Vec out = *this;
+    for(H::inl_szt_ i = 0; i < N; ++i)
+      out.v_.lanes[i] = T(out.v_.lanes[i] << shift);
+    return out;
+#endif
+  }
+
+  template <typename U = T, typename = typename
+    std::enable_if<std::is_integral<U>::value>::type>
+  Vec operator>>(int shift) const NOEXCEPT {
+#if EFL_HAS_VECTOR_EXT
+    return Vec(v_ >> shift);
+#else
+    Vec out = *this;
+    for(H::inl_szt_ i = 0; i < N; ++i)
+      out.v_.lanes[i] = T(out.v_.lanes[i] >> shift);
+    return out;
+#endif
+  }
+
+  //=== Comparison ===//
+
+#if EFL_HAS_VECTOR_EXT
+# define EFLI_VEC_COMPARE_(op) \
+  friend Mask operator op(Vec a, Vec b) NOEXCEPT \
+  { return Mask(typename Mask::Native(a.v_ op b.v_)); }
+#else
+# define EFLI_VEC_COMPARE_(op) \
+  friend Mask operator op(Vec a, Vec b) NOEXCEPT { \
+    Mask out; \
+    for(H::inl_szt_ i = 0; i < N; ++i) \
+      out.v_.lanes[i] = (a.v_.lanes[i] op b.v_.lanes[i]) ? MaskT(-1) : MaskT(0); \
+    return out; \
+  }
+#endif
+
+  EFLI_VEC_COMPARE_(==)
+  EFLI_VEC_COMPARE_(!=)
+  EFLI_VEC_COMPARE_(<)
+  EFLI_VEC_COMPARE_(<=)
+  EFLI_VEC_COMPARE_(>)
+  EFLI_VEC_COMPARE_(>=)
+
+#undef EFLI_VEC_BINARY_
+#undef EFLI_VEC_COMPARE_
+
+  /// Lanes of `a` where `mask` is set, otherwise lanes of `b`.
+  static Vec select(const Mask& mask, Vec a, Vec b) NOEXCEPT {
+#if EFL_HAS_VECTOR_EXT
+    typedef typename Mask::Native Bits;
+    const Bits bits = mask.v_;
+    const Bits out = (Bits(a.v_) & bits) | (Bits(b.v_) & ~bits);
+    return Vec(Native(out));
+#else
+    for(H::inl_szt_ i = 0; i < N; ++i) {
+      if(!mask.v_.lanes[i])
+        a.v_.lanes[i] = b.v_.lanes[i];
+    }
+    return a;
+#endif
+  }
+
+  static Vec min(Vec a, Vec b) NOEXCEPT { return select(a < b, a, b); }
+  static Vec max(Vec a, Vec b) NOEXCEPT { return select(a > b, a, b); }
+
+  /// Rearranges lanes, lane `i` of the result is lane `I[i]` of this.
+  template <int...I>
+  Vec shuffle() const NOEXCEPT {
+    static_assert(sizeof...(I) == N, "One index per lane is required.");
+#if EFL_HAS_VECTOR_EXT && EFL_HAS_BUILTIN(__builtin_shufflevector)
+    return Vec(__builtin_shufflevector(v_, v_, I...));
+#elif EFL_HAS_VECTOR_EXT && defined(__GNUC__)
+    return Vec(__builtin_shuffle(v_, typename Mask::Native { MaskT(I)... }));
+#else
+    const int index[] = { I... };
+    Vec out;
+    for(H::inl_szt_ i = 0; i < N; ++i)
+      out.set(i, this->at(H::inl_szt_(index[i])));
+    return out;
+#endif
+  }
+
+  /// Converts every lane to `U`, like `static_cast`.
+  template <typename U>
+  Vec<U, N> convert() const NOEXCEPT {
+#if EFL_HAS_VECTOR_EXT && EFL_HAS_BUILTIN(__builtin_convertvector)
+    return Vec<U, N>(__builtin_convertvector(v_, typename Vec<U, N>::Native));
+#else
+    Vec<U, N> out;
+    for(H::inl_szt_ i = 0; i < N; ++i)
+      out.set(i, static_cast<U>(this->at(i)));
+    return out;
+#endif
+  }
+
+  /// Lanes `[0, N/2)` and `[N/2, N)`.
+  Vec<T, (N > 1 ? N / 2 : 1)> low() const NOEXCEPT {
+    Vec<T, (N > 1 ? N / 2 : 1)> out;
+    std::memcpy(&out.v_, &v_, sizeof(out.v_));
+    return out;
+  }
+  Vec<T, (N > 1 ? N / 2 : 1)> high() const NOEXCEPT {
+    Vec<T, (N > 1 ? N / 2 : 1)> out;
+    std::memcpy(&out.v_, reinterpret_cast<const char*>(&v_)
+      + (N > 1 ? size / 2 : 0), sizeof(out.v_));
+    return out;
+  }
+
+  //=== Reductions ===//
+
+  T sum() const NOEXCEPT
+  { return this->reduce(std::integral_constant<bool, (N > 1)>(), Add()); }
+  T minimum() const NOEXCEPT
+  { return this->reduce(std::integral_constant<bool, (N > 1)>(), Min()); }
+  T maximum() const NOEXCEPT
+  { return this->reduce(std::integral_constant<bool, (N > 1)>(), Max()); }
+
+  /// For masks, if any/all lanes are set.
+  bool any() const NOEXCEPT {
+    for(H::inl_szt_ i = 0; i < N; ++i) {
+      if(this->at(i) != T(0))
+        return true;
+    }
+    return false;
+  }
+  bool all() const NOEXCEPT {
+    for(H::inl_szt_ i = 0; i < N; ++i) {
+      if(this->at(i) == T(0))
+        return false;
+    }
+    return true;
+  }
+
+private:
+  struct Add {
+    template <typename V> V operator()(V a, V b) const { return a + b; }
+  };
+  struct Min {
+    template <typename V> V operator()(V a, V b) const { return V::min(a, b); }
+  };
+  struct Max {
+    template <typename V> V operator()(V a, V b) const { return V::max(a, b); }
+  };
+
+  /// Halves the width each step, so it takes log2(N) vector ops.
+  template <typename Op>
+  T reduce(std::true_type, Op op) const NOEXCEPT {
+    const auto half = op(this->low(), this->high());
+    return half.reduce(std::integral_constant<bool, (N > 2)>(), op);
+  }
+  template <typename Op>
+  T reduce(std::false_type, Op) const NOEXCEPT { return this->at(0); }
+
+  Vec bitwise(Vec b, int kind) const NOEXCEPT {
+#if EFL_HAS_VECTOR_EXT
+    switch(kind) {
+     case 0:  return Vec(v_ & b.v_);
+     case 1:  return Vec(v_ | b.v_);
+     default: return Vec(v_ ^ b.v_);
+    }
+#else
+    Vec out;
+    for(H::inl_szt_ i = 0; i < N; ++i) {
+      const T x = v_.lanes[i], y = b.v_.lanes[i];
+      out.v_.lanes[i] = T((kind == 0) ? (x & y) : (kind == 1) ? (x | y) : (x ^ y));
+    }
+    return out;
+#endif
+  }
+
+private:
+  Native v_;
+};
+
+} // namespace config
+} // namespace efl
+
+#endif // EFL_VEC_HPP